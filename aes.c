@@ -0,0 +1,282 @@
+/* aes.c - AES-256 (FIPS 197) and GCM (SP 800-38D) in portable C.
+ * The cipher works on bytes (no large tables, no 32 bit ints needed);
+ * GHASH is Shoup's 4 bit table method on unsigned long words, every
+ * result that may carry past bit 31 is masked.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "aes.h"
+#include "sha256.h"
+
+#define M32(x)		((x)&0xffffffffUL)
+
+static const unsigned char sbox[256]=
+{
+	0x63,0x7c,0x77,0x7b,0xf2,0x6b,0x6f,0xc5,0x30,0x01,0x67,0x2b,0xfe,0xd7,0xab,0x76,
+	0xca,0x82,0xc9,0x7d,0xfa,0x59,0x47,0xf0,0xad,0xd4,0xa2,0xaf,0x9c,0xa4,0x72,0xc0,
+	0xb7,0xfd,0x93,0x26,0x36,0x3f,0xf7,0xcc,0x34,0xa5,0xe5,0xf1,0x71,0xd8,0x31,0x15,
+	0x04,0xc7,0x23,0xc3,0x18,0x96,0x05,0x9a,0x07,0x12,0x80,0xe2,0xeb,0x27,0xb2,0x75,
+	0x09,0x83,0x2c,0x1a,0x1b,0x6e,0x5a,0xa0,0x52,0x3b,0xd6,0xb3,0x29,0xe3,0x2f,0x84,
+	0x53,0xd1,0x00,0xed,0x20,0xfc,0xb1,0x5b,0x6a,0xcb,0xbe,0x39,0x4a,0x4c,0x58,0xcf,
+	0xd0,0xef,0xaa,0xfb,0x43,0x4d,0x33,0x85,0x45,0xf9,0x02,0x7f,0x50,0x3c,0x9f,0xa8,
+	0x51,0xa3,0x40,0x8f,0x92,0x9d,0x38,0xf5,0xbc,0xb6,0xda,0x21,0x10,0xff,0xf3,0xd2,
+	0xcd,0x0c,0x13,0xec,0x5f,0x97,0x44,0x17,0xc4,0xa7,0x7e,0x3d,0x64,0x5d,0x19,0x73,
+	0x60,0x81,0x4f,0xdc,0x22,0x2a,0x90,0x88,0x46,0xee,0xb8,0x14,0xde,0x5e,0x0b,0xdb,
+	0xe0,0x32,0x3a,0x0a,0x49,0x06,0x24,0x5c,0xc2,0xd3,0xac,0x62,0x91,0x95,0xe4,0x79,
+	0xe7,0xc8,0x37,0x6d,0x8d,0xd5,0x4e,0xa9,0x6c,0x56,0xf4,0xea,0x65,0x7a,0xae,0x08,
+	0xba,0x78,0x25,0x2e,0x1c,0xa6,0xb4,0xc6,0xe8,0xdd,0x74,0x1f,0x4b,0xbd,0x8b,0x8a,
+	0x70,0x3e,0xb5,0x66,0x48,0x03,0xf6,0x0e,0x61,0x35,0x57,0xb9,0x86,0xc1,0x1d,0x9e,
+	0xe1,0xf8,0x98,0x11,0x69,0xd9,0x8e,0x94,0x9b,0x1e,0x87,0xe9,0xce,0x55,0x28,0xdf,
+	0x8c,0xa1,0x89,0x0d,0xbf,0xe6,0x42,0x68,0x41,0x99,0x2d,0x0f,0xb0,0x54,0xbb,0x16
+};
+
+/* reduction of the 4 bits shifted out of GHASH's Z */
+static const unsigned long last4[16]=
+{
+	0x0000,0x1c20,0x3840,0x2460,0x7080,0x6ca0,0x48c0,0x54e0,
+	0xe100,0xfd20,0xd940,0xc560,0x9180,0x8da0,0xa9c0,0xb5e0
+};
+
+static unsigned char xtime(unsigned char x)
+{
+	return (unsigned char)((x<<1)^(x&0x80?0x1b:0));
+}
+
+static unsigned long get32be(const unsigned char *p)
+{
+	return ((unsigned long)p[0]<<24)|((unsigned long)p[1]<<16)|((unsigned long)p[2]<<8)|p[3];
+}
+
+static void put32be(unsigned char *p, unsigned long v)
+{
+	p[0]=(unsigned char)(v>>24);
+	p[1]=(unsigned char)(v>>16);
+	p[2]=(unsigned char)(v>>8);
+	p[3]=(unsigned char)v;
+}
+
+void aes_block(const aes_ctx *c, const unsigned char in[16], unsigned char out[16])
+{
+	unsigned char s[16], t[16], a0, a1, a2, a3, x;
+	const unsigned char *rk=c->rk;
+	int i, r;
+
+	for(i=0;i<16;i++)
+		s[i]=in[i]^rk[i];
+	for(r=1;r<=14;r++)
+	{
+		/* SubBytes and ShiftRows; the state is stored by columns */
+		t[0]=sbox[s[0]]; t[1]=sbox[s[5]]; t[2]=sbox[s[10]]; t[3]=sbox[s[15]];
+		t[4]=sbox[s[4]]; t[5]=sbox[s[9]]; t[6]=sbox[s[14]]; t[7]=sbox[s[3]];
+		t[8]=sbox[s[8]]; t[9]=sbox[s[13]]; t[10]=sbox[s[2]]; t[11]=sbox[s[7]];
+		t[12]=sbox[s[12]]; t[13]=sbox[s[1]]; t[14]=sbox[s[6]]; t[15]=sbox[s[11]];
+		if(r<14)	/* MixColumns, not in the last round */
+			for(i=0;i<16;i+=4)
+			{
+				a0=t[i]; a1=t[i+1]; a2=t[i+2]; a3=t[i+3];
+				x=a0^a1^a2^a3;
+				t[i]^=x^xtime(a0^a1);
+				t[i+1]^=x^xtime(a1^a2);
+				t[i+2]^=x^xtime(a2^a3);
+				t[i+3]^=x^xtime(a3^a0);
+			}
+		rk+=16;
+		for(i=0;i<16;i++)
+			s[i]=t[i]^rk[i];
+	}
+	memcpy(out,s,16);
+}
+
+/* z = z*x^4 in GCM's bit order */
+static void shift4(unsigned long *z)
+{
+	unsigned int rem=(unsigned int)(z[3]&0xf);
+	z[3]=M32((z[3]>>4)|(z[2]<<28));
+	z[2]=M32((z[2]>>4)|(z[1]<<28));
+	z[1]=M32((z[1]>>4)|(z[0]<<28));
+	z[0]=(z[0]>>4)^(last4[rem]<<16);
+}
+
+/* x = x*H */
+static void gmul(const aes_ctx *c, unsigned char x[16])
+{
+	unsigned long z[4];
+	unsigned int lo, hi;
+	int i, j;
+
+	memcpy(z,c->hl[x[15]&0xf],sizeof(z));
+	for(i=15;i>=0;i--)
+	{
+		lo=x[i]&0xf;
+		hi=x[i]>>4;
+		if(i!=15)
+		{
+			shift4(z);
+			for(j=0;j<4;j++)
+				z[j]^=c->hl[lo][j];
+		}
+		shift4(z);
+		for(j=0;j<4;j++)
+			z[j]^=c->hl[hi][j];
+	}
+	for(j=0;j<4;j++)
+		put32be(x+4*j,z[j]);
+}
+
+void aes_setkey(aes_ctx *c, const unsigned char key[AES_KEYLEN])
+{
+	unsigned char *w=c->rk, t[4], u, rcon=1, h[16];
+	unsigned long *v;
+	int i, j;
+
+	memcpy(w,key,32);
+	for(i=32;i<240;i+=4)
+	{
+		memcpy(t,w+i-4,4);
+		if(i%32==0)
+		{
+			u=t[0];
+			t[0]=sbox[t[1]]^rcon;
+			t[1]=sbox[t[2]];
+			t[2]=sbox[t[3]];
+			t[3]=sbox[u];
+			rcon=xtime(rcon);
+		}
+		else if(i%32==16)
+			for(j=0;j<4;j++)
+				t[j]=sbox[t[j]];
+		for(j=0;j<4;j++)
+			w[i+j]=w[i-32+j]^t[j];
+	}
+
+	/* GHASH key H=E(0); hl[i] is i*H with bit 3 of i as x^0 */
+	memset(h,0,16);
+	aes_block(c,h,h);
+	memset(c->hl,0,sizeof(c->hl));
+	v=c->hl[8];
+	for(j=0;j<4;j++)
+		v[j]=get32be(h+4*j);
+	for(i=4;i>0;i>>=1)
+	{
+		memcpy(c->hl[i],v,4*sizeof(unsigned long));
+		v=c->hl[i];
+		u=(unsigned char)(v[3]&1);
+		v[3]=M32((v[3]>>1)|(v[2]<<31));
+		v[2]=M32((v[2]>>1)|(v[1]<<31));
+		v[1]=M32((v[1]>>1)|(v[0]<<31));
+		v[0]=(v[0]>>1)^(u?0xe1000000UL:0);
+	}
+	for(i=2;i<=8;i*=2)
+		for(j=1;j<i;j++)
+		{
+			c->hl[i+j][0]=c->hl[i][0]^c->hl[j][0];
+			c->hl[i+j][1]=c->hl[i][1]^c->hl[j][1];
+			c->hl[i+j][2]=c->hl[i][2]^c->hl[j][2];
+			c->hl[i+j][3]=c->hl[i][3]^c->hl[j][3];
+		}
+}
+
+/* counter mode and GHASH in one pass; tag is computed, not checked */
+static void gcm(const aes_ctx *c, const unsigned char *iv, unsigned char *buf,
+	unsigned int len, unsigned char *tag, int decrypt)
+{
+	unsigned char ctr[16], ks[16], y[16];
+	unsigned int i, n, k;
+
+	memcpy(ctr,iv,12);
+	ctr[12]=ctr[13]=ctr[14]=0;
+	ctr[15]=1;
+	memset(y,0,16);
+	for(i=0;i<len;i+=n)
+	{
+		n=len-i<16?len-i:16;
+		for(k=15;++ctr[k]==0 && k>12;k--)
+			;
+		aes_block(c,ctr,ks);
+		for(k=0;k<n;k++)
+		{
+			if(decrypt)
+				y[k]^=buf[i+k];
+			buf[i+k]^=ks[k];
+			if(!decrypt)
+				y[k]^=buf[i+k];
+		}
+		gmul(c,y);
+	}
+	/* lengths: no AAD, len*8 bits of ciphertext */
+	y[11]^=(unsigned char)((unsigned long)len>>29);
+	put32be(ks,(unsigned long)len<<3);
+	for(k=0;k<4;k++)
+		y[12+k]^=ks[k];
+	gmul(c,y);
+	ctr[12]=ctr[13]=ctr[14]=0;
+	ctr[15]=1;
+	aes_block(c,ctr,ks);
+	for(k=0;k<16;k++)
+		tag[k]=y[k]^ks[k];
+}
+
+void aes_gcm_encrypt(const aes_ctx *c, const unsigned char *iv, unsigned char *buf,
+	unsigned int len, unsigned char *tag)
+{
+	gcm(c,iv,buf,len,tag,0);
+}
+
+/* decrypts in place; -1 if the tag does not match (buf is garbage then) */
+int aes_gcm_decrypt(const aes_ctx *c, const unsigned char *iv, unsigned char *buf,
+	unsigned int len, const unsigned char *tag)
+{
+	unsigned char t[16], d=0;
+	int k;
+	gcm(c,iv,buf,len,t,1);
+	for(k=0;k<16;k++)
+		d|=t[k]^tag[k];
+	return d?-1:0;
+}
+
+/* the key is the SHA-256 of the key file, so any file of enough
+ * random bytes (or a long passphrase) will do */
+int aes_keyfile(const char *fn, unsigned char key[AES_KEYLEN])
+{
+	FILE *f;
+	sha256_ctx s;
+	unsigned char buf[256];
+	unsigned int n;
+	unsigned long total=0;
+
+	if((f=fopen(fn,"rb"))==NULL)
+		return -1;
+	sha256_init(&s);
+	while((n=fread(buf,1,sizeof(buf),f))>0)
+	{
+		sha256_update(&s,buf,n);
+		total+=n;
+	}
+	fclose(f);
+	sha256_final(&s,key);
+	memset(buf,0,sizeof(buf));
+	return total>=16?0:-1;
+}
+
+/* key of one image: SHA-256 of salt (16 bytes) and the key file's key;
+ * check (8 bytes) tells whether a key file is the right one */
+void aes_imagekey(aes_ctx *c, const unsigned char key[AES_KEYLEN],
+	const unsigned char *salt, unsigned char *check)
+{
+	static const unsigned char what[16]="RAWHDD KEYCHECK";
+	sha256_ctx s;
+	unsigned char k[32], t[16];
+
+	sha256_init(&s);
+	sha256_update(&s,salt,16);
+	sha256_update(&s,key,AES_KEYLEN);
+	sha256_final(&s,k);
+	aes_setkey(c,k);
+	memset(k,0,sizeof(k));
+	aes_block(c,what,t);
+	memcpy(check,t,8);
+}
@@ -0,0 +1,41 @@
+/* aes.h - AES-256 (FIPS 197) and GCM (SP 800-38D) in portable C.
+ * Works with 16 bit ints; GHASH uses 4 bit tables of unsigned long words.
+ * Only what rawhdd needs: 96 bit IVs, no additional authenticated data.
+ */
+
+#ifndef AES_H
+#define AES_H
+
+#define AES_KEYLEN	32
+#define AES_IVLEN	12
+#define AES_TAGLEN	16
+
+/* Image written by rawhdd -o=aes: a header, then one record per track at
+ * AES_HDRLEN+track*(AES_IVLEN+track bytes+AES_TAGLEN), so any track can
+ * be read on its own. Header: magic (16 bytes), cylinders, heads,
+ * sectors (16 bit each), 2 bytes 0, salt (16), key check (8), number of
+ * the last session that wrote (32 bit). Record: IV (session, track, both
+ * 32 bit, 4 bytes 0), the track encrypted, GCM tag. Records never written
+ * are zeros. Numbers are little endian. Each image has its own key,
+ * derived from the key file and the salt; a resumed copy is a new
+ * session, so an IV is never used twice. */
+#define AES_MAGIC	"RAWHDD AES-GCM\r\n"
+#define AES_HDRLEN	64
+
+typedef struct aes_ctx
+{
+	unsigned char	rk[240];	/* round keys */
+	unsigned long	hl[16][4];	/* multiples of H for GHASH */
+} aes_ctx;
+
+void aes_setkey(aes_ctx *c, const unsigned char key[AES_KEYLEN]);
+void aes_block(const aes_ctx *c, const unsigned char in[16], unsigned char out[16]);
+void aes_gcm_encrypt(const aes_ctx *c, const unsigned char *iv, unsigned char *buf,
+	unsigned int len, unsigned char *tag);
+int aes_gcm_decrypt(const aes_ctx *c, const unsigned char *iv, unsigned char *buf,
+	unsigned int len, const unsigned char *tag);
+int aes_keyfile(const char *fn, unsigned char key[AES_KEYLEN]);
+void aes_imagekey(aes_ctx *c, const unsigned char key[AES_KEYLEN],
+	const unsigned char *salt, unsigned char *check);
+
+#endif
@@ -0,0 +1,51 @@
+/* crc32c.c - CRC-32C (Castagnoli), table driven.
+ * A 286 has no CRC instruction; one table lookup per byte is as fast as
+ * it gets there.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include "crc32c.h"
+
+static unsigned long table[256];
+static int ready=0;
+
+static void mktable(void)
+{
+	unsigned int i,j;
+	unsigned long c;
+	for(i=0;i<256;i++)
+	{
+		c=i;
+		for(j=0;j<8;j++)
+			c=(c&1)?(c>>1)^0x82f63b78UL:c>>1;
+		table[i]=c;
+	}
+	ready=1;
+}
+
+/* start with crc=0; pass the previous result to continue a checksum */
+unsigned long crc32c(unsigned long crc, const void *buf, unsigned int len)
+{
+	const unsigned char *p=buf;
+	if(!ready)
+		mktable();
+	crc=~crc&0xffffffffUL;
+	while(len--)
+		crc=table[(unsigned char)crc^*p++]^(crc>>8);
+	return ~crc&0xffffffffUL;
+}
+
+void put32le(unsigned char *p, unsigned long v)
+{
+	p[0]=(unsigned char)v;
+	p[1]=(unsigned char)(v>>8);
+	p[2]=(unsigned char)(v>>16);
+	p[3]=(unsigned char)(v>>24);
+}
+
+unsigned long get32le(const unsigned char *p)
+{
+	return p[0]|((unsigned long)p[1]<<8)|((unsigned long)p[2]<<16)|((unsigned long)p[3]<<24);
+}
@@ -0,0 +1,15 @@
+/* crc32c.h - CRC-32C (Castagnoli), table driven.
+ * Used for the per-block checksum sidecar (.CRC) of an image.
+ */
+
+#ifndef CRC32C_H
+#define CRC32C_H
+
+/* .CRC file: "RHC1", block size (32 bit LE), then one 32 bit LE CRC per block */
+#define CRC_HDRLEN	8
+
+unsigned long crc32c(unsigned long crc, const void *buf, unsigned int len);
+void put32le(unsigned char *p, unsigned long v);
+unsigned long get32le(const unsigned char *p);
+
+#endif
@@ -0,0 +1,49 @@
+/* entropy.c - Shannon entropy of a block's byte values, in integers.
+ * One pass to count byte values, then a sum over the 256 counts using a
+ * fixed point log2; no floating point, so it costs little more than a
+ * CRC on machines without an FPU.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include "entropy.h"
+
+/* log2(1+i/64), 1/256 units */
+static const unsigned char frac[64]={
+	0, 6, 11, 17, 22, 28, 33, 38, 44, 49, 54, 59, 63, 68, 73, 78,
+	82, 87, 92, 96, 100, 105, 109, 113, 118, 122, 126, 130, 134, 138, 142, 146,
+	150, 154, 157, 161, 165, 169, 172, 176, 179, 183, 186, 190, 193, 197, 200, 203,
+	207, 210, 213, 216, 220, 223, 226, 229, 232, 235, 238, 241, 244, 247, 250, 253
+};
+
+/* log2(n), 1/256 units, n>0 */
+static unsigned int lg(unsigned int n)
+{
+	unsigned int b=0;
+	while((n>>b)>1)
+		b++;
+	n=b>=6?n>>(b-6):n<<(6-b);	/* 64..127 */
+	return b*256+frac[n-64];
+}
+
+/* H = log2(len) - sum(c*log2(c))/len over the counts c of each byte value */
+unsigned int entropy(const void *buf, unsigned int len)
+{
+	unsigned int count[256];
+	const unsigned char *p=buf;
+	unsigned long sum=0;
+	unsigned int i, h;
+
+	if(len==0)
+		return 0;
+	for(i=0;i<256;i++)
+		count[i]=0;
+	for(i=0;i<len;i++)
+		count[p[i]]++;
+	for(i=0;i<256;i++)
+		if(count[i]>1)
+			sum+=(unsigned long)count[i]*lg(count[i]);
+	h=lg(len)-(unsigned int)(sum/len);
+	return h>8*256?ENT_ONE*8:h/(256/ENT_ONE);
+}
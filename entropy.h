@@ -0,0 +1,21 @@
+/* entropy.h - Shannon entropy of a block's byte values, in integers.
+ * Encrypted and compressed data come out close to 8 bits per byte; such
+ * tracks are not worth compressing again, and runs of them on a drive
+ * usually mark encrypted volumes or archives.
+ */
+
+#ifndef ENTROPY_H
+#define ENTROPY_H
+
+/* bits per byte, in 1/32 bit units (0..256) */
+#define ENT_ONE		32
+/* compressing data above this is wasted time (7.75 bits per byte) */
+#define ENT_NOPACK	248
+
+/* .ENT file: "RHE1", block size (32 bit LE), then one byte per block:
+ * 0 if the block was not copied, else 1+min(entropy,254) */
+#define ENT_HDRLEN	8
+
+unsigned int entropy(const void *buf, unsigned int len);
+
+#endif
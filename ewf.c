@@ -0,0 +1,369 @@
+/* ewf.c - Expert Witness (EnCase E01) image writer.
+ * Layout of each segment file: file header, then header and volume
+ * sections (first segment) or a data section (the others), then groups of
+ * sectors, table and table2 sections, ended by a next section, or by
+ * error2, hash and done in the last segment. Chunks are stored as they
+ * are, with their Adler-32; there is no deflate here, except that an
+ * all-zero chunk is the canned zlib stream below.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ewf.h"
+#include "crc32c.h"
+#include "rhmap.h"
+
+#define CHUNKBYTES	(EWF_CHUNK*512)
+#define SECTLEN		76		/* section descriptor */
+#define TABROOM		(2*(SECTLEN+28+4L*EWF_MAXTAB))	/* table and table2 */
+
+/* zlib stream of CHUNKBYTES zeros */
+static const unsigned char zchunk[52]=
+{
+	0x78,0xda,0xed,0xc1,0x01,0x01,0x00,0x00,0x00,0x80,0x90,0xfe,0xaf,
+	0xee,0x08,0x0a,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x18,0x80,0x00,0x00,0x01
+};
+
+static unsigned char sbuf[1052];	/* section being built */
+
+static unsigned long adler32(unsigned long a, const unsigned char *p, unsigned int n)
+{
+	unsigned long s1=a&0xffff, s2=(a>>16)&0xffff;
+	unsigned int k;
+	while(n>0)
+	{
+		k=n<5552?n:5552;	/* s2 can't overflow 32 bits before % */
+		n-=k;
+		while(k--)
+		{
+			s1+=*p++;
+			s2+=s1;
+		}
+		s1%=65521UL;
+		s2%=65521UL;
+	}
+	return (s2<<16)|s1;
+}
+
+/* section descriptor; size includes the descriptor. Offsets are 64 bit
+ * in the file, rawhdd never gets past 2 GB per segment */
+static int section(ewfout *e, const char *type, long next, unsigned long size)
+{
+	unsigned char d[SECTLEN];
+	memset(d,0,sizeof(d));
+	strncpy((char *)d,type,16);
+	put32le(d+16,(unsigned long)next);
+	put32le(d+24,size);
+	put32le(d+72,adler32(1,d,72));
+	return fwrite(d,sizeof(d),1,e->f)==1?0:-1;
+}
+
+static int put_sect(ewfout *e, const char *type, const void *data, unsigned int len)
+{
+	long pos=ftell(e->f);
+	if(section(e,type,pos+SECTLEN+len,SECTLEN+len)!=0)
+		return -1;
+	return fwrite(data,len,1,e->f)==1?0:-1;
+}
+
+/* case information, as zlib text in a single stored block */
+static int header(ewfout *e)
+{
+	char text[200], date[32];
+	unsigned int n;
+	unsigned long a;
+	time_t t=time(NULL);
+	struct tm *tm=localtime(&t);
+
+	sprintf(date,"%d %d %d %d %d %d",tm->tm_year+1900,tm->tm_mon+1,tm->tm_mday,
+		tm->tm_hour,tm->tm_min,tm->tm_sec);
+	n=sprintf(text,"1\r\nmain\r\nc\tn\ta\te\tt\tav\tov\tm\tu\tp\tr\r\n"
+		"\t1\tCHS %u,%u,%u\t\t\trawhdd\tDOS\t%s\t%s\t0\tf\r\n\r\n",
+		e->cyls,e->heads,e->spt,date,date);
+	sbuf[0]=0x78;
+	sbuf[1]=0x01;
+	sbuf[2]=1;		/* last block, stored */
+	sbuf[3]=(unsigned char)n;
+	sbuf[4]=(unsigned char)(n>>8);
+	sbuf[5]=(unsigned char)~n;
+	sbuf[6]=(unsigned char)(~n>>8);
+	memcpy(sbuf+7,text,n);
+	a=adler32(1,(unsigned char *)text,n);
+	sbuf[7+n]=(unsigned char)(a>>24);	/* zlib wants it big endian */
+	sbuf[8+n]=(unsigned char)(a>>16);
+	sbuf[9+n]=(unsigned char)(a>>8);
+	sbuf[10+n]=(unsigned char)a;
+	return put_sect(e,"header",sbuf,n+11);
+}
+
+/* media description: "volume" in the first segment, "data" in the others */
+static int volume(ewfout *e, const char *type)
+{
+	memset(sbuf,0,1052);
+	sbuf[0]=1;					/* fixed disk */
+	put32le(sbuf+4,(e->sectors+EWF_CHUNK-1)/EWF_CHUNK);
+	put32le(sbuf+8,EWF_CHUNK);
+	put32le(sbuf+12,512);
+	put32le(sbuf+16,e->sectors);
+	put32le(sbuf+24,e->cyls);
+	put32le(sbuf+28,e->heads);
+	put32le(sbuf+32,e->spt);
+	sbuf[36]=1;					/* physical image */
+	sbuf[52]=1;					/* compression: fast */
+	put32le(sbuf+56,EWF_CHUNK);			/* error granularity */
+	put32le(sbuf+64,(unsigned long)time(NULL));	/* set identifier */
+	put32le(sbuf+68,e->sectors);
+	put32le(sbuf+1048,adler32(1,sbuf,1048));
+	return put_sect(e,type,sbuf,1052);
+}
+
+static int seg_start(ewfout *e)
+{
+	static const unsigned char sig[8]={'E','V','F',9,13,10,0xff,0};
+	char name[NAMELEN], ext[4];
+	unsigned char h[13];
+
+	if(e->seg>99)
+		return -1;
+	sprintf(ext,"E%02u",e->seg);
+	if(sidecar(name,sizeof(name),e->fn,ext)!=0 || (e->f=fopen(name,"wb"))==NULL)
+		return -1;
+	memcpy(h,sig,8);
+	h[8]=1;
+	h[9]=(unsigned char)e->seg;
+	h[10]=(unsigned char)(e->seg>>8);
+	h[11]=h[12]=0;
+	if(fwrite(h,sizeof(h),1,e->f)!=1)
+		return -1;
+	if(e->seg==1)
+		return header(e)!=0 || volume(e,"volume")!=0?-1:0;
+	return volume(e,"data");
+}
+
+static int table(ewfout *e, const char *type)
+{
+	unsigned char b[4];
+	unsigned long a=1, size=SECTLEN+24+4L*e->ntab+4;
+	unsigned int i;
+
+	if(section(e,type,ftell(e->f)+size,size)!=0)
+		return -1;
+	memset(sbuf,0,24);
+	put32le(sbuf,e->ntab);
+	put32le(sbuf+8,(unsigned long)e->sectoff);	/* entries are relative to it */
+	put32le(sbuf+20,adler32(1,sbuf,20));
+	fwrite(sbuf,24,1,e->f);
+	for(i=0;i<e->ntab;i++)
+	{
+		put32le(b,e->tab[i]);
+		a=adler32(a,b,4);
+		fwrite(b,4,1,e->f);
+	}
+	put32le(b,a);
+	return fwrite(b,4,1,e->f)==1?0:-1;
+}
+
+/* close the open sectors section and write its tables */
+static int table_end(ewfout *e)
+{
+	long pos;
+	if(e->sectoff<0)
+		return 0;
+	pos=ftell(e->f);
+	fseek(e->f,e->sectoff,SEEK_SET);
+	if(section(e,"sectors",pos,(unsigned long)(pos-e->sectoff))!=0)
+		return -1;
+	fseek(e->f,pos,SEEK_SET);
+	if(table(e,"table")!=0 || table(e,"table2")!=0)
+		return -1;
+	e->sectoff=-1;
+	e->ntab=0;
+	return 0;
+}
+
+static int iszero(const unsigned char *p, unsigned int n)
+{
+	while(n>0 && *p==0)
+	{
+		p++;
+		n--;
+	}
+	return n==0;
+}
+
+/* room kept after the chunks of a segment: its tables, then next, or
+ * error2, hash and done if it turns out to be the last. Errors are added
+ * before the chunk that holds them, so nerr is final for the last one */
+static long tail(ewfout *e)
+{
+	return TABROOM+(e->nerr>0?SECTLEN+520+8L*e->nerr+4:0)+SECTLEN+36+SECTLEN;
+}
+
+static int put_chunk(ewfout *e)
+{
+	long pos=ftell(e->f);
+	unsigned int n=e->fill;
+	int z=n==CHUNKBYTES && iszero(e->chunk,n);
+
+	if(pos+n+4+tail(e)>(long)e->segsize)	/* on to the next segment */
+	{
+		if(table_end(e)!=0)
+			return -1;
+		pos=ftell(e->f);
+		if(section(e,"next",pos,SECTLEN)!=0 || fclose(e->f)!=0)
+			return -1;
+		e->f=NULL;
+		e->seg++;
+		if(seg_start(e)!=0)
+			return -1;
+	}
+	if(e->sectoff<0)
+	{
+		e->sectoff=ftell(e->f);
+		if(section(e,"sectors",0,0)!=0)	/* filled in by table_end() */
+			return -1;
+	}
+	pos=ftell(e->f);
+	e->tab[e->ntab++]=(unsigned long)(pos-e->sectoff)|(z?0x80000000UL:0);
+	e->fill=0;
+	if(z)
+	{
+		if(fwrite(zchunk,sizeof(zchunk),1,e->f)!=1)
+			return -1;
+	}
+	else
+	{
+		put32le(e->chunk+n,adler32(1,e->chunk,n));
+		if(fwrite(e->chunk,n+4,1,e->f)!=1)
+			return -1;
+	}
+	return e->ntab==EWF_MAXTAB?table_end(e):0;
+}
+
+static int add_err(ewfout *e, unsigned long lba)
+{
+	unsigned long *ne;
+	if(e->nerr>0 && e->err[2*e->nerr-2]+e->err[2*e->nerr-1]==lba)
+	{
+		e->err[2*e->nerr-1]++;
+		return 0;
+	}
+	if(e->nerr==e->maxerr)
+	{
+		if(e->maxerr>=0x1ff0)	/* keep list within one segment */
+			return -1;
+		ne=realloc(e->err,(e->maxerr+64)*2*sizeof(unsigned long));
+		if(ne==NULL)
+			return -1;
+		e->err=ne;
+		e->maxerr+=64;
+	}
+	e->err[2*e->nerr]=lba;
+	e->err[2*e->nerr+1]=1;
+	e->nerr++;
+	return 0;
+}
+
+static int error2(ewfout *e)
+{
+	unsigned char b[4];
+	unsigned long a=1, size=SECTLEN+520+8L*e->nerr+4;
+	unsigned int i;
+
+	if(section(e,"error2",ftell(e->f)+size,size)!=0)
+		return -1;
+	memset(sbuf,0,520);
+	put32le(sbuf,e->nerr);
+	put32le(sbuf+516,adler32(1,sbuf,516));
+	fwrite(sbuf,520,1,e->f);
+	for(i=0;i<2*e->nerr;i++)
+	{
+		put32le(b,e->err[i]);
+		a=adler32(a,b,4);
+		fwrite(b,4,1,e->f);
+	}
+	put32le(b,a);
+	return fwrite(b,4,1,e->f)==1?0:-1;
+}
+
+/* segsize: largest segment file, at least 1 MB */
+int ewf_open(ewfout *e, const char *fn, unsigned int cyls, unsigned int heads,
+	unsigned int spt, unsigned long segsize)
+{
+	memset(e,0,sizeof(ewfout));
+	e->fn=fn;
+	e->segsize=segsize;
+	e->seg=1;
+	e->cyls=cyls;
+	e->heads=heads;
+	e->spt=spt;
+	e->sectors=(unsigned long)cyls*heads*spt;
+	e->sectoff=-1;
+	md5_init(&e->md5);
+	e->chunk=malloc(CHUNKBYTES+4);
+	e->tab=malloc(EWF_MAXTAB*sizeof(unsigned long));
+	if(e->chunk==NULL || e->tab==NULL)
+		return -1;
+	return seg_start(e);
+}
+
+/* add n sectors, in order; bad[i] is set for unreadable ones */
+int ewf_write(ewfout *e, const char *buf, unsigned int n, const unsigned char *bad)
+{
+	unsigned int i, k, len=n*512;
+
+	for(i=0;i<n;i++,e->lba++)
+		if(bad!=NULL && bad[i] && add_err(e,e->lba)!=0)
+			return -1;
+	md5_update(&e->md5,buf,len);
+	while(len>0)
+	{
+		k=CHUNKBYTES-e->fill;
+		if(k>len)
+			k=len;
+		memcpy(e->chunk+e->fill,buf,k);
+		e->fill+=k;
+		buf+=k;
+		len-=k;
+		if(e->fill==CHUNKBYTES && put_chunk(e)!=0)
+			return -1;
+	}
+	return 0;
+}
+
+/* complete=0 (copy interrupted) leaves out the last chunk and the hash */
+int ewf_close(ewfout *e, int complete)
+{
+	int res=0;
+	if(e->f==NULL)
+		return 0;
+	if(complete)
+	{
+		if(e->fill>0)
+			res|=put_chunk(e);
+		res|=table_end(e);
+		if(e->nerr>0)
+			res|=error2(e);
+		memset(sbuf,0,36);
+		md5_final(&e->md5,sbuf);
+		put32le(sbuf+32,adler32(1,sbuf,32));
+		res|=put_sect(e,"hash",sbuf,36);
+	}
+	else
+		res|=table_end(e);
+	res|=section(e,"done",ftell(e->f),SECTLEN);
+	if(fclose(e->f)!=0)
+		res=-1;
+	e->f=NULL;
+	free(e->chunk);
+	free(e->tab);
+	free(e->err);
+	return res;
+}
@@ -0,0 +1,42 @@
+/* ewf.h - Expert Witness (EnCase E01) image writer.
+ * Sectors are added in order; they go out as 32 KB chunks in segment files
+ * NAME.E01, NAME.E02, ... with the chunk table, the unreadable sectors
+ * (error2 section) and the MD5 of the media, so forensic tools can open
+ * a rawhdd copy without converting it first.
+ */
+
+#ifndef EWF_H
+#define EWF_H
+
+#include <stdio.h>
+#include "md5.h"
+
+#define EWF_CHUNK	64		/* sectors per chunk */
+#define EWF_MAXTAB	16375		/* chunks per table (EnCase limit) */
+
+typedef struct ewfout
+{
+	FILE		*f;
+	const char	*fn;		/* first segment, NAME.E01 */
+	unsigned long	segsize;	/* largest segment file */
+	unsigned int	seg;		/* segment being written, 1 based */
+	unsigned int	cyls, heads, spt;
+	unsigned long	sectors;	/* size of the media */
+	unsigned long	lba;		/* next sector to come */
+	unsigned char	*chunk;		/* chunk being filled, room for checksum */
+	unsigned int	fill;		/* bytes in chunk */
+	long		sectoff;	/* open sectors section, -1 if none */
+	unsigned long	*tab;		/* its chunk table */
+	unsigned int	ntab;
+	unsigned long	*err;		/* unreadable runs, first/count pairs */
+	unsigned int	nerr;
+	unsigned int	maxerr;
+	md5_ctx		md5;
+} ewfout;
+
+int ewf_open(ewfout *e, const char *fn, unsigned int cyls, unsigned int heads,
+	unsigned int spt, unsigned long segsize);
+int ewf_write(ewfout *e, const char *buf, unsigned int n, const unsigned char *bad);
+int ewf_close(ewfout *e, int complete);
+
+#endif
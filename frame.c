@@ -0,0 +1,41 @@
+/* frame.c - framed stream format of rawhdd (-o=frame).
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include "frame.h"
+#include "crc32c.h"
+
+void fr_header(unsigned char *h, const frame *fr)
+{
+	h[0]='R';
+	h[1]='F';
+	h[2]=(unsigned char)fr->type;
+	h[3]=(unsigned char)fr->flags;
+	put32le(h+4,fr->lba);
+	h[8]=(unsigned char)fr->count;
+	h[9]=(unsigned char)(fr->count>>8);
+	h[10]=(unsigned char)fr->len;
+	h[11]=(unsigned char)(fr->len>>8);
+}
+
+/* returns -1 if h is not a frame header */
+int fr_parse(const unsigned char *h, frame *fr)
+{
+	if(h[0]!='R' || h[1]!='F')
+		return -1;
+	fr->type=h[2];
+	fr->flags=h[3];
+	fr->lba=get32le(h+4);
+	fr->count=h[8]|((unsigned int)h[9]<<8);
+	fr->len=h[10]|((unsigned int)h[11]<<8);
+	return 0;
+}
+
+/* CRC of header and payload (length taken from the header) */
+unsigned long fr_crc(const unsigned char *h, const unsigned char *payload)
+{
+	unsigned int len=h[10]|((unsigned int)h[11]<<8);
+	return crc32c(crc32c(0,h,FR_HDRLEN),payload,len);
+}
@@ -0,0 +1,44 @@
+/* frame.h - framed stream format of rawhdd (-o=frame).
+ * A stream of frames can go to a pipe, a serial port or a network share
+ * and still carries what a plain image loses: where each block goes,
+ * which sectors were unreadable, and how far the copy got. rawrecv turns
+ * it back into an image plus a rawhdd.log style map.
+ *
+ * Frame: 'R','F', type, flags, lba (32 bit), count (16 bit),
+ * len (16 bit), len bytes of payload, CRC-32C of all that (32 bit).
+ * All numbers are little endian.
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#define FR_HDRLEN	12
+#define FR_CRCLEN	4
+
+/* frame types */
+#define FR_GEOM		'G'	/* payload: cylinders, heads, sectors (16 bit each) */
+#define FR_DATA		'D'	/* count sectors starting at lba */
+#define FR_LZ		'L'	/* same, LZ4 block compressed */
+#define FR_ZERO		'Z'	/* count sectors starting at lba are all zero */
+#define FR_ERR		'E'	/* count sectors at lba were unreadable; sent
+				 * before the data frame of their track */
+#define FR_CKPT		'C'	/* all sectors before lba were sent */
+#define FR_END		'X'	/* end of stream */
+
+/* flags of FR_GEOM */
+#define FR_KEEP		1	/* resumed or updated copy: don't truncate image */
+
+typedef struct frame
+{
+	int		type;
+	int		flags;
+	unsigned long	lba;
+	unsigned int	count;
+	unsigned int	len;
+} frame;
+
+void fr_header(unsigned char *h, const frame *fr);
+int fr_parse(const unsigned char *h, frame *fr);
+unsigned long fr_crc(const unsigned char *h, const unsigned char *payload);
+
+#endif
@@ -0,0 +1,263 @@
+/* inflate.c - deflate decoder (RFC 1951) for whole chunks in memory.
+ * Canonical Huffman decoding one bit at a time, after Mark Adler's puff.
+ * Back references only reach into the output buffer, which holds the
+ * whole chunk. Tables are static: not reentrant, but small on DOS stacks.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <string.h>
+#include "inflate.h"
+
+#define MAXBITS		15
+#define NLEN		288
+#define NDIST		30
+
+typedef struct huff
+{
+	short	count[MAXBITS+1];	/* codes of each length */
+	short	symbol[NLEN];		/* symbols by code */
+} huff;
+
+typedef struct state
+{
+	const unsigned char	*in;
+	unsigned int		inlen, inpos;
+	unsigned long		bitbuf;
+	int			bitcnt;
+	unsigned char		*out;
+	unsigned int		outlen, outpos;
+	int			err;
+} state;
+
+static const short lbase[29]={3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,
+	35,43,51,59,67,83,99,115,131,163,195,227,258};
+static const short lext[29]={0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,
+	3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const unsigned short dbase[30]={1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,
+	257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+static const short dext[30]={0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,
+	7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+static huff lencode, distcode;
+static short lengths[NLEN+NDIST];
+
+static unsigned int bits(state *s, int n)
+{
+	unsigned int v;
+	while(s->bitcnt<n)
+	{
+		if(s->inpos==s->inlen)
+		{
+			s->err=1;
+			return 0;
+		}
+		s->bitbuf|=(unsigned long)s->in[s->inpos++]<<s->bitcnt;
+		s->bitcnt+=8;
+	}
+	v=(unsigned int)(s->bitbuf&((1UL<<n)-1));
+	s->bitbuf>>=n;
+	s->bitcnt-=n;
+	return v;
+}
+
+static int decode(state *s, huff *h)
+{
+	long code=0, first=0;
+	int index=0, len, count;
+	for(len=1;len<=MAXBITS;len++)
+	{
+		code|=bits(s,1);
+		count=h->count[len];
+		if(code-count<first)
+			return h->symbol[index+(int)(code-first)];
+		index+=count;
+		first=(first+count)<<1;
+		code<<=1;
+	}
+	s->err=1;
+	return 0;
+}
+
+/* build decoding table from code lengths; -1 if over-subscribed */
+static int construct(huff *h, const short *length, int n)
+{
+	short offs[MAXBITS+1];
+	int i, left=1;
+	memset(h->count,0,sizeof(h->count));
+	for(i=0;i<n;i++)
+		h->count[length[i]]++;
+	for(i=1;i<=MAXBITS;i++)
+	{
+		left<<=1;
+		left-=h->count[i];
+		if(left<0)
+			return -1;
+	}
+	offs[1]=0;
+	for(i=1;i<MAXBITS;i++)
+		offs[i+1]=offs[i]+h->count[i];
+	for(i=0;i<n;i++)
+		if(length[i]!=0)
+			h->symbol[offs[length[i]]++]=(short)i;
+	return 0;
+}
+
+static int stored(state *s)
+{
+	unsigned int len;
+	s->bitbuf=0;	/* to a byte boundary */
+	s->bitcnt=0;
+	if(s->inpos+4>s->inlen)
+		return -1;
+	len=s->in[s->inpos]|(s->in[s->inpos+1]<<8);
+	if((unsigned int)(s->in[s->inpos+2]|(s->in[s->inpos+3]<<8))!=(~len&0xffffU))
+		return -1;
+	s->inpos+=4;
+	if(s->inpos+len>s->inlen || s->outpos+len>s->outlen)
+		return -1;
+	memcpy(s->out+s->outpos,s->in+s->inpos,len);
+	s->inpos+=len;
+	s->outpos+=len;
+	return 0;
+}
+
+static int codes(state *s)
+{
+	int sym;
+	unsigned int len, dist;
+	for(;;)
+	{
+		sym=decode(s,&lencode);
+		if(s->err)
+			return -1;
+		if(sym<256)
+		{
+			if(s->outpos==s->outlen)
+				return -1;
+			s->out[s->outpos++]=(unsigned char)sym;
+		}
+		else if(sym==256)
+			return 0;
+		else
+		{
+			sym-=257;
+			if(sym>=29)
+				return -1;
+			len=lbase[sym]+bits(s,lext[sym]);
+			sym=decode(s,&distcode);
+			if(s->err || sym>=30)
+				return -1;
+			dist=dbase[sym]+bits(s,dext[sym]);
+			if(s->err || dist>s->outpos || s->outpos+len>s->outlen)
+				return -1;
+			while(len--)	/* may overlap, byte by byte */
+			{
+				s->out[s->outpos]=s->out[s->outpos-dist];
+				s->outpos++;
+			}
+		}
+	}
+}
+
+static int fixed(state *s)
+{
+	int i;
+	for(i=0;i<144;i++)
+		lengths[i]=8;
+	for(;i<256;i++)
+		lengths[i]=9;
+	for(;i<280;i++)
+		lengths[i]=7;
+	for(;i<NLEN;i++)
+		lengths[i]=8;
+	construct(&lencode,lengths,NLEN);
+	for(i=0;i<NDIST;i++)
+		lengths[i]=5;
+	construct(&distcode,lengths,NDIST);
+	return codes(s);
+}
+
+static int dynamic(state *s)
+{
+	static const short order[19]={16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+	int nlen, ndist, ncode, i, sym, len, rep;
+
+	nlen=bits(s,5)+257;
+	ndist=bits(s,5)+1;
+	ncode=bits(s,4)+4;
+	if(s->err || nlen>NLEN || ndist>NDIST)
+		return -1;
+	for(i=0;i<19;i++)
+		lengths[order[i]]=i<ncode?(short)bits(s,3):0;
+	if(construct(&lencode,lengths,19)!=0)
+		return -1;
+	for(i=0;i<nlen+ndist;)
+	{
+		sym=decode(s,&lencode);
+		if(s->err)
+			return -1;
+		if(sym<16)
+		{
+			lengths[i++]=(short)sym;
+			continue;
+		}
+		len=0;
+		if(sym==16)
+		{
+			if(i==0)
+				return -1;
+			len=lengths[i-1];
+			rep=3+bits(s,2);
+		}
+		else if(sym==17)
+			rep=3+bits(s,3);
+		else
+			rep=11+bits(s,7);
+		if(s->err || i+rep>nlen+ndist)
+			return -1;
+		while(rep--)
+			lengths[i++]=(short)len;
+	}
+	if(lengths[256]==0 || construct(&lencode,lengths,nlen)!=0 ||
+		construct(&distcode,lengths+nlen,ndist)!=0)
+		return -1;
+	return codes(s);
+}
+
+long inflate_raw(const unsigned char *in, unsigned int inlen, unsigned char *out, unsigned int outlen)
+{
+	state s;
+	int last, type, res;
+
+	memset(&s,0,sizeof(s));
+	s.in=in;
+	s.inlen=inlen;
+	s.out=out;
+	s.outlen=outlen;
+	do
+	{
+		last=bits(&s,1);
+		type=bits(&s,2);
+		if(s.err)
+			return -1;
+		switch(type)
+		{
+			case 0: res=stored(&s); break;
+			case 1: res=fixed(&s); break;
+			case 2: res=dynamic(&s); break;
+			default: res=-1;
+		}
+		if(res!=0 || s.err)
+			return -1;
+	} while(!last);
+	return (long)s.outpos;
+}
+
+long inflate_zlib(const unsigned char *in, unsigned int inlen, unsigned char *out, unsigned int outlen)
+{
+	if(inlen<2 || (in[0]&0x0f)!=8 || ((in[0]<<8)|in[1])%31!=0 || (in[1]&0x20))
+		return -1;
+	return inflate_raw(in+2,inlen-2,out,outlen);
+}
@@ -0,0 +1,13 @@
+/* inflate.h - deflate decoder (RFC 1951) for whole chunks in memory.
+ * Enough to read compressed chunks of E01 and qcow2 images.
+ */
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+/* raw deflate data in, at most outlen bytes out; returns bytes out or -1 */
+long inflate_raw(const unsigned char *in, unsigned int inlen, unsigned char *out, unsigned int outlen);
+/* same for a zlib stream (header and Adler-32 are not checked) */
+long inflate_zlib(const unsigned char *in, unsigned int inlen, unsigned char *out, unsigned int outlen);
+
+#endif
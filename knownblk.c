@@ -0,0 +1,181 @@
+/* knownblk.c - blocks that match known files, by MD5.
+ * Blocks follow the file system's clusters: they start at LBAs equal to
+ * align modulo the block size, and a block that crosses a track boundary
+ * is finished with the next track when that comes next.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "knownblk.h"
+#include "md5.h"
+#include "crc32c.h"
+
+void kb_bits(const unsigned char *md5, int lbits, unsigned long *bit)
+{
+	int i;
+	for(i=0;i<KB_K;i++)
+		bit[i]=get32le(md5+4*i)&((1UL<<lbits)-1);
+}
+
+/* reads header, bucket indexes and filter; returns -1 if not a database
+ * or too big for memory */
+int kb_open(kbdb *k, const char *fn, unsigned long align)
+{
+	unsigned char hdr[KB_HDRLEN];
+	unsigned long size;
+	unsigned int i, n;
+
+	memset(k,0,sizeof(kbdb));
+	if((k->f=fopen(fn,"rb"))==NULL)
+		return -1;
+	if(fread(hdr,KB_HDRLEN,1,k->f)!=1 || memcmp(hdr,KB_MAGIC,16)!=0)
+		goto bad;
+	k->bsize=get32le(hdr+16);
+	k->count=get32le(hdr+20);
+	k->lbits=hdr[24];
+	if(k->bsize==0 || k->bsize%512 || k->bsize>32768UL || k->lbits<KB_MINBITS || k->lbits>KB_MAXBITS)
+		goto bad;
+	if((k->bucket=malloc((KB_NBUCKET+1)*sizeof(unsigned long)))==NULL ||
+		(k->carry=malloc((unsigned int)k->bsize))==NULL)
+		goto bad;
+	for(i=0;i<=KB_NBUCKET;i++)
+	{
+		if(fread(hdr,4,1,k->f)!=1)
+			goto bad;
+		k->bucket[i]=get32le(hdr);
+	}
+	size=1UL<<(k->lbits-3);
+	n=size<(1UL<<KB_PIECE)?(unsigned int)size:1U<<KB_PIECE;
+	for(i=0;size>0;i++,size-=n)
+		if((k->filter[i]=malloc(n))==NULL || fread(k->filter[i],n,1,k->f)!=1)
+			goto bad;
+	k->hashes=ftell(k->f);
+	k->align=align%(k->bsize/512);
+	return 0;
+bad:
+	kb_close(k);
+	return -1;
+}
+
+/* 1 if md5 is in the database, 0 if not, -1 on read error */
+int kb_known(kbdb *k, const unsigned char *md5)
+{
+	unsigned long bit[KB_K], lo, hi, mid;
+	unsigned char h[16];
+	int i, c;
+
+	kb_bits(md5,k->lbits,bit);
+	for(i=0;i<KB_K;i++)
+		if(!(k->filter[(unsigned int)(bit[i]>>(KB_PIECE+3))][(unsigned int)(bit[i]>>3)&((1U<<KB_PIECE)-1)]&1<<(int)(bit[i]&7)))
+			return 0;
+	i=md5[0]<<4|md5[1]>>4;
+	lo=k->bucket[i];
+	hi=k->bucket[i+1];
+	while(lo<hi)
+	{
+		mid=lo+(hi-lo)/2;
+		if(fseek(k->f,k->hashes+(long)mid*16,SEEK_SET)!=0 || fread(h,16,1,k->f)!=1)
+			return -1;
+		if((c=memcmp(md5,h,16))==0)
+			return 1;
+		if(c<0)
+			hi=mid;
+		else
+			lo=mid+1;
+	}
+	return 0;
+}
+
+/* add n known sectors at lba to the ranges written to out */
+static int mark(kbdb *k, unsigned long lba, unsigned long n)
+{
+	int res=0;
+	k->total+=n;
+	if(k->n>0 && lba==k->first+k->n)
+	{
+		k->n+=n;
+		return 0;
+	}
+	if(k->n>0 && k->out!=NULL)
+		res=fprintf(k->out,"KNOWN: %lu-%lu (%lu sectors)\n",k->first,k->first+k->n-1,k->n)<0?-1:0;
+	k->first=lba;
+	k->n=n;
+	return res;
+}
+
+static int check(kbdb *k, unsigned long lba, unsigned char *p, int blank)
+{
+	md5_ctx c;
+	unsigned char h[16];
+	int r;
+	md5_init(&c);
+	md5_update(&c,p,(unsigned int)k->bsize);
+	md5_final(&c,h);
+	if((r=kb_known(k,h))<=0)
+		return r;
+	if(blank)
+		memset(p,0,(unsigned int)k->bsize);
+	return mark(k,lba,k->bsize/512);
+}
+
+/* check the blocks of a track; blank=1 zeros known blocks that lie
+ * wholly in it (so sparse outputs leave them out). Returns -1 on error */
+int kb_track(kbdb *k, unsigned long lba, unsigned char *buf, unsigned int sectors, int blank)
+{
+	unsigned int bs=(unsigned int)(k->bsize/512), pos, n;
+
+	if(k->clen>0 && k->cnext==lba)
+	{
+		n=bs-k->clen<sectors?bs-k->clen:sectors;
+		memcpy(k->carry+k->clen*512,buf,n*512);
+		k->clen+=n;
+		k->cnext+=n;
+		if(k->clen<bs)
+			return 0;
+		k->clen=0;
+		if(check(k,lba+n-bs,k->carry,0)<0)
+			return -1;
+		pos=n;
+	}
+	else
+		pos=(unsigned int)((k->align+bs-lba%bs)%bs);
+	k->clen=0;
+	for(;pos+bs<=sectors;pos+=bs)
+		if(check(k,lba+pos,buf+pos*512,blank)<0)
+			return -1;
+	if(pos<sectors)
+	{
+		k->clen=sectors-pos;
+		memcpy(k->carry,buf+pos*512,k->clen*512);
+		k->cnext=lba+sectors;
+	}
+	return 0;
+}
+
+/* writes the pending range; out is left for the caller to close */
+int kb_close(kbdb *k)
+{
+	int res=0;
+	unsigned int i;
+	if(k->n>0 && k->out!=NULL &&
+		fprintf(k->out,"KNOWN: %lu-%lu (%lu sectors)\n",k->first,k->first+k->n-1,k->n)<0)
+		res=-1;
+	k->n=0;
+	if(k->f!=NULL)
+		fclose(k->f);
+	k->f=NULL;
+	free(k->bucket);
+	free(k->carry);
+	k->bucket=NULL;
+	k->carry=NULL;
+	for(i=0;i<sizeof(k->filter)/sizeof(k->filter[0]);i++)
+	{
+		free(k->filter[i]);
+		k->filter[i]=NULL;
+	}
+	return res;
+}
@@ -0,0 +1,49 @@
+/* knownblk.h - blocks that match known files (operating system installs,
+ * applications), looked up by MD5 in a database made by rawkbdb. A Bloom
+ * filter in memory answers for most unknown blocks; the rest need a few
+ * reads of the sorted hashes on disk.
+ */
+
+#ifndef KNOWNBLK_H
+#define KNOWNBLK_H
+
+#include <stdio.h>
+
+/* Database: header of KB_HDRLEN bytes: magic (16), block size, number of
+ * hashes (32 bit LE each), log2 of the filter's bits (8 bit), 7 bytes 0;
+ * KB_NBUCKET+1 indexes (32 bit LE) of the first hash starting with each
+ * 12 bit prefix (the last one is the count); the filter; the MD5s,
+ * sorted. Each hash sets KB_K filter bits, given by its 32 bit words */
+#define KB_MAGIC	"RAWHDD KNOWN\r\n\0\0"
+#define KB_HDRLEN	32
+#define KB_NBUCKET	4096
+#define KB_K		4
+#define KB_MINBITS	13
+#define KB_MAXBITS	21	/* 256 KB, in 32 KB pieces for real mode */
+#define KB_PIECE	15	/* log2 of bytes per piece */
+
+typedef struct kbdb
+{
+	FILE		*f;
+	unsigned long	bsize;		/* block size in bytes */
+	unsigned long	count;
+	int		lbits;
+	unsigned long	*bucket;
+	unsigned char	*filter[1<<(KB_MAXBITS-3-KB_PIECE)];
+	long		hashes;		/* offset of the first MD5 */
+	unsigned long	align;		/* blocks start at LBAs = align mod bsize/512 */
+	unsigned char	*carry;		/* start of a block that crosses tracks */
+	unsigned long	cnext;		/* LBA that continues it */
+	unsigned int	clen;		/* sectors in carry */
+	FILE		*out;		/* ranges of known sectors */
+	unsigned long	first, n;	/* pending range */
+	unsigned long	total;		/* known sectors */
+} kbdb;
+
+void kb_bits(const unsigned char *md5, int lbits, unsigned long *bit);
+int kb_open(kbdb *k, const char *fn, unsigned long align);
+int kb_known(kbdb *k, const unsigned char *md5);
+int kb_track(kbdb *k, unsigned long lba, unsigned char *buf, unsigned int sectors, int blank);
+int kb_close(kbdb *k);
+
+#endif
@@ -0,0 +1,130 @@
+/* lz.c - LZ4 block format compression of one buffer (up to 64K).
+ * Output follows the LZ4 block format (token, literals, 16 bit offset,
+ * match length; last 5 bytes are literals), so other LZ4 decoders can
+ * read it too. The hash uses 16 bit arithmetic only: a 286 has no fast
+ * 32 bit multiply.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <string.h>
+#include "lz.h"
+
+#define HBITS		12
+#define MINMATCH	4
+#define LASTLITS	5	/* last bytes are always literals */
+#define MFLIMIT		12	/* last match starts at least this far from end */
+#define HASH(p)		((((((p)[0]|((unsigned int)(p)[1]<<8))^((p)[2]|((unsigned int)(p)[3]<<8))*40503u))&0xffffu)>>(16-HBITS))
+
+static unsigned int ht[1<<HBITS];	/* position+1 of last occurrence, 0: none */
+
+/* put a length continuation (after the 15 in the token) */
+static unsigned int putlen(unsigned char *op, unsigned int len)
+{
+	unsigned int n=0;
+	while(len>=255)
+	{
+		op[n++]=255;
+		len-=255;
+	}
+	op[n++]=(unsigned char)len;
+	return n;
+}
+
+/* returns compressed size, or 0 if output would not fit in max bytes */
+unsigned int lz_pack(const unsigned char *in, unsigned int n, unsigned char *out, unsigned int max)
+{
+	unsigned int ip=0, anchor=0, op=0;
+	unsigned int ref, ml, ll, h;
+
+	memset(ht,0,sizeof(ht));
+	while(n>=MFLIMIT+1 && ip<n-MFLIMIT)
+	{
+		h=HASH(in+ip);
+		ref=ht[h];
+		ht[h]=ip+1;
+		if(ref==0 || memcmp(in+ref-1,in+ip,MINMATCH)!=0)
+		{
+			ip++;
+			continue;
+		}
+		ref--;
+		for(ml=MINMATCH;ip+ml<n-LASTLITS && in[ref+ml]==in[ip+ml];ml++)
+			;
+		ll=ip-anchor;
+		/* token + lengths + literals + offset */
+		if((unsigned long)op+1+ll/255+1+ll+2+(ml-MINMATCH)/255+1>max)
+			return 0;
+		out[op]=(unsigned char)(((ll<15?ll:15)<<4)|(ml-MINMATCH<15?ml-MINMATCH:15));
+		op++;
+		if(ll>=15)
+			op+=putlen(out+op,ll-15);
+		memcpy(out+op,in+anchor,ll);
+		op+=ll;
+		out[op++]=(unsigned char)(ip-ref);
+		out[op++]=(unsigned char)((ip-ref)>>8);
+		if(ml-MINMATCH>=15)
+			op+=putlen(out+op,ml-MINMATCH-15);
+		ip+=ml;
+		anchor=ip;
+	}
+	ll=n-anchor;
+	if((unsigned long)op+1+ll/255+1+ll>max)
+		return 0;
+	out[op++]=(unsigned char)((ll<15?ll:15)<<4);
+	if(ll>=15)
+		op+=putlen(out+op,ll-15);
+	memcpy(out+op,in+anchor,ll);
+	return op+ll;
+}
+
+/* returns decompressed size or -1 if input is corrupt or too big */
+long lz_unpack(const unsigned char *in, unsigned int n, unsigned char *out, unsigned int max)
+{
+	unsigned int ip=0, op=0;
+	unsigned int off;
+	unsigned long len;
+	unsigned char t, b;
+
+	while(ip<n)
+	{
+		t=in[ip++];
+		len=t>>4;
+		if(len==15)
+			do
+			{
+				if(ip>=n)
+					return -1;
+				b=in[ip++];
+				len+=b;
+			} while(b==255);
+		if(len>(unsigned long)(n-ip) || len>(unsigned long)(max-op))
+			return -1;
+		memcpy(out+op,in+ip,(unsigned int)len);
+		ip+=(unsigned int)len;
+		op+=(unsigned int)len;
+		if(ip==n)	/* last sequence has no match */
+			break;
+		if(ip+2>n)
+			return -1;
+		off=in[ip]|((unsigned int)in[ip+1]<<8);
+		ip+=2;
+		if(off==0 || off>op)
+			return -1;
+		len=(t&15)+MINMATCH;
+		if((t&15)==15)
+			do
+			{
+				if(ip>=n)
+					return -1;
+				b=in[ip++];
+				len+=b;
+			} while(b==255);
+		if(len>(unsigned long)(max-op))
+			return -1;
+		for(;len>0;len--,op++)	/* may overlap */
+			out[op]=out[op-off];
+	}
+	return op;
+}
@@ -0,0 +1,14 @@
+/* lz.h - LZ4 block format compression of one buffer (up to 64K).
+ * Greedy, single hash table; small enough for a real mode program.
+ */
+
+#ifndef LZ_H
+#define LZ_H
+
+/* worst case growth of lz_pack() output */
+#define LZ_BOUND(n)	((n)+(n)/255+16)
+
+unsigned int lz_pack(const unsigned char *in, unsigned int n, unsigned char *out, unsigned int max);
+long lz_unpack(const unsigned char *in, unsigned int n, unsigned char *out, unsigned int max);
+
+#endif
@@ -0,0 +1,120 @@
+/* md5.c - MD5 (RFC 1321) in portable C.
+ * Written for 16 bit compilers like sha256.c: unsigned long is (at least)
+ * 32 bits, so every result that may carry past bit 31 is masked.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <string.h>
+#include "md5.h"
+
+#define M32(x)		((x)&0xffffffffUL)
+#define ROTL(x,n)	M32(((x)<<(n))|((x)>>(32-(n))))
+#define F(x,y,z)	(((x)&(y))|(~(x)&(z)))
+#define G(x,y,z)	(((x)&(z))|((y)&~(z)))
+#define H(x,y,z)	((x)^(y)^(z))
+#define I(x,y,z)	M32((y)^((x)|~(z)))
+
+static const unsigned long k[64]=
+{
+	0xd76aa478UL,0xe8c7b756UL,0x242070dbUL,0xc1bdceeeUL,0xf57c0fafUL,0x4787c62aUL,0xa8304613UL,0xfd469501UL,
+	0x698098d8UL,0x8b44f7afUL,0xffff5bb1UL,0x895cd7beUL,0x6b901122UL,0xfd987193UL,0xa679438eUL,0x49b40821UL,
+	0xf61e2562UL,0xc040b340UL,0x265e5a51UL,0xe9b6c7aaUL,0xd62f105dUL,0x02441453UL,0xd8a1e681UL,0xe7d3fbc8UL,
+	0x21e1cde6UL,0xc33707d6UL,0xf4d50d87UL,0x455a14edUL,0xa9e3e905UL,0xfcefa3f8UL,0x676f02d9UL,0x8d2a4c8aUL,
+	0xfffa3942UL,0x8771f681UL,0x6d9d6122UL,0xfde5380cUL,0xa4beea44UL,0x4bdecfa9UL,0xf6bb4b60UL,0xbebfbc70UL,
+	0x289b7ec6UL,0xeaa127faUL,0xd4ef3085UL,0x04881d05UL,0xd9d4d039UL,0xe6db99e5UL,0x1fa27cf8UL,0xc4ac5665UL,
+	0xf4292244UL,0x432aff97UL,0xab9423a7UL,0xfc93a039UL,0x655b59c3UL,0x8f0ccc92UL,0xffeff47dUL,0x85845dd1UL,
+	0x6fa87e4fUL,0xfe2ce6e0UL,0xa3014314UL,0x4e0811a1UL,0xf7537e82UL,0xbd3af235UL,0x2ad7d2bbUL,0xeb86d391UL
+};
+
+static const unsigned char r[64]=
+{
+	7,12,17,22,7,12,17,22,7,12,17,22,7,12,17,22,
+	5,9,14,20,5,9,14,20,5,9,14,20,5,9,14,20,
+	4,11,16,23,4,11,16,23,4,11,16,23,4,11,16,23,
+	6,10,15,21,6,10,15,21,6,10,15,21,6,10,15,21
+};
+
+static void transform(md5_ctx *c, const unsigned char *p)
+{
+	unsigned long w[16];
+	unsigned long a,b,cc,d,f,t;
+	int i, g;
+
+	for(i=0;i<16;i++,p+=4)
+		w[i]=p[0]|((unsigned long)p[1]<<8)|((unsigned long)p[2]<<16)|((unsigned long)p[3]<<24);
+	a=c->h[0]; b=c->h[1]; cc=c->h[2]; d=c->h[3];
+	for(i=0;i<64;i++)
+	{
+		switch(i>>4)
+		{
+			case 0: f=F(b,cc,d); g=i; break;
+			case 1: f=G(b,cc,d); g=(5*i+1)&15; break;
+			case 2: f=H(b,cc,d); g=(3*i+5)&15; break;
+			default: f=I(b,cc,d); g=(7*i)&15; break;
+		}
+		t=d; d=cc; cc=b;
+		b=M32(b+ROTL(M32(a+f+k[i]+w[g]),r[i]));
+		a=t;
+	}
+	c->h[0]=M32(c->h[0]+a); c->h[1]=M32(c->h[1]+b);
+	c->h[2]=M32(c->h[2]+cc); c->h[3]=M32(c->h[3]+d);
+}
+
+void md5_init(md5_ctx *c)
+{
+	c->h[0]=0x67452301UL; c->h[1]=0xefcdab89UL;
+	c->h[2]=0x98badcfeUL; c->h[3]=0x10325476UL;
+	c->lo=c->hi=0;
+	c->n=0;
+}
+
+void md5_update(md5_ctx *c, const void *data, unsigned int len)
+{
+	const unsigned char *p=data;
+	unsigned int m;
+
+	c->lo=M32(c->lo+len);
+	if(c->lo<len)
+		c->hi++;
+	while(len>0)
+	{
+		m=64-c->n;
+		if(m>len)
+			m=len;
+		memcpy(c->buf+c->n,p,m);
+		c->n+=m;
+		p+=m;
+		len-=m;
+		if(c->n==64)
+		{
+			transform(c,c->buf);
+			c->n=0;
+		}
+	}
+}
+
+void md5_final(md5_ctx *c, unsigned char out[16])
+{
+	unsigned long hibits=M32((c->hi<<3)|(c->lo>>29));
+	unsigned long lobits=M32(c->lo<<3);
+	int i;
+
+	c->buf[c->n++]=0x80;
+	if(c->n>56)
+	{
+		memset(c->buf+c->n,0,64-c->n);
+		transform(c,c->buf);
+		c->n=0;
+	}
+	memset(c->buf+c->n,0,56-c->n);
+	for(i=0;i<4;i++)	/* length is little endian in MD5 */
+	{
+		c->buf[56+i]=(unsigned char)(lobits>>(8*i));
+		c->buf[60+i]=(unsigned char)(hibits>>(8*i));
+	}
+	transform(c,c->buf);
+	for(i=0;i<16;i++)
+		out[i]=(unsigned char)(c->h[i>>2]>>(8*(i&3)));
+}
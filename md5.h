@@ -0,0 +1,20 @@
+/* md5.h - MD5 (RFC 1321) in portable C.
+ * Works with 16 bit ints; all 32 bit arithmetic uses unsigned long.
+ */
+
+#ifndef MD5_H
+#define MD5_H
+
+typedef struct md5_ctx
+{
+	unsigned long	h[4];
+	unsigned long	lo, hi;		/* message length in bytes */
+	unsigned char	buf[64];
+	unsigned int	n;		/* bytes in buf */
+} md5_ctx;
+
+void md5_init(md5_ctx *c);
+void md5_update(md5_ctx *c, const void *data, unsigned int len);
+void md5_final(md5_ctx *c, unsigned char out[16]);
+
+#endif
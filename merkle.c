@@ -0,0 +1,121 @@
+/* merkle.c - Merkle tree hash of an image, one leaf per track.
+ * The tree is the one from RFC 6962: leaf = SHA-256(0x00|data),
+ * node = SHA-256(0x01|left|right), and for n leaves the left subtree
+ * holds the largest power of two smaller than n. The leaf file holds
+ * leaf i at offset 32*i, followed by the root once it is known.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "sha256.h"
+#include "merkle.h"
+
+/* leaf hash of a track */
+void mk_hash(unsigned char *h, const void *buf, unsigned int len)
+{
+	sha256_ctx c;
+	unsigned char pfx=0;
+
+	sha256_init(&c);
+	sha256_update(&c,&pfx,1);
+	sha256_update(&c,buf,len);
+	sha256_final(&c,h);
+}
+
+/* hash of a track, written at its place in the leaf file */
+int mk_leaf(FILE *f, unsigned long leaf, const void *buf, unsigned int len)
+{
+	unsigned char h[MK_HASHLEN];
+
+	mk_hash(h,buf,len);
+	if(fseek(f,(long)leaf*MK_HASHLEN,SEEK_SET)!=0)
+		return -1;
+	if(fwrite(h,MK_HASHLEN,1,f)!=1)
+		return -1;
+	return 0;
+}
+
+/* like mk_leaf(), but first compare with the stored leaf hash.
+ * returns 0 if the track is unchanged, 1 if the new hash was stored,
+ * -1 on I/O error */
+int mk_changed(FILE *f, unsigned long leaf, const void *buf, unsigned int len)
+{
+	unsigned char h[MK_HASHLEN];
+	unsigned char old[MK_HASHLEN];
+
+	mk_hash(h,buf,len);
+	if(fseek(f,(long)leaf*MK_HASHLEN,SEEK_SET)!=0)
+		return -1;
+	if(fread(old,MK_HASHLEN,1,f)==1 && memcmp(old,h,MK_HASHLEN)==0)
+		return 0;
+	if(fseek(f,(long)leaf*MK_HASHLEN,SEEK_SET)!=0)
+		return -1;
+	if(fwrite(h,MK_HASHLEN,1,f)!=1)
+		return -1;
+	return 1;
+}
+
+/* out=node(l,r); out may be l */
+static void mk_node(unsigned char *out, const unsigned char *l, const unsigned char *r)
+{
+	sha256_ctx c;
+	unsigned char pfx=1;
+
+	sha256_init(&c);
+	sha256_update(&c,&pfx,1);
+	sha256_update(&c,l,MK_HASHLEN);
+	sha256_update(&c,r,MK_HASHLEN);
+	sha256_final(&c,out);
+}
+
+/* root of leaves added in order. Only O(log n) hashes are kept: st
+ * holds the roots of complete subtrees in decreasing size */
+void mk_start(mk_ctx *c)
+{
+	c->sp=0;
+	c->n=0;
+}
+
+void mk_add(mk_ctx *c, const unsigned char *leaf)
+{
+	unsigned long j;
+	memcpy(c->st[c->sp++],leaf,MK_HASHLEN);
+	for(j=++c->n;(j&1)==0;j>>=1,c->sp--)
+		mk_node(c->st[c->sp-2],c->st[c->sp-2],c->st[c->sp-1]);
+}
+
+/* the root; at least one leaf must have been added */
+void mk_end(mk_ctx *c, unsigned char root[MK_HASHLEN])
+{
+	for(;c->sp>1;c->sp--)
+		mk_node(c->st[c->sp-2],c->st[c->sp-2],c->st[c->sp-1]);
+	memcpy(root,c->st[0],MK_HASHLEN);
+}
+
+/* compute root from nleaves leaf hashes and store it after the last leaf.
+ * Returns 1 if a leaf is missing (never written), -1 on I/O error, 0 on
+ * success. */
+int mk_root(FILE *f, unsigned long nleaves, unsigned char root[MK_HASHLEN])
+{
+	static const unsigned char zero[MK_HASHLEN];
+	mk_ctx c;
+	unsigned char h[MK_HASHLEN];
+	unsigned long i;
+
+	if(nleaves==0 || fseek(f,0L,SEEK_SET)!=0)
+		return -1;
+	mk_start(&c);
+	for(i=0;i<nleaves;i++)
+	{
+		if(fread(h,MK_HASHLEN,1,f)!=1 || memcmp(h,zero,MK_HASHLEN)==0)
+			return 1;
+		mk_add(&c,h);
+	}
+	mk_end(&c,root);
+	if(fseek(f,(long)nleaves*MK_HASHLEN,SEEK_SET)!=0 || fwrite(root,MK_HASHLEN,1,f)!=1)
+		return -1;
+	return 0;
+}
@@ -0,0 +1,28 @@
+/* merkle.h - Merkle tree hash of an image, one leaf per track.
+ * Leaf hashes are kept in a sidecar file so that tracks can be hashed
+ * in any order (resumed runs) and the root computed at the end.
+ */
+
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include <stdio.h>
+
+#define MK_HASHLEN	32
+
+typedef struct mk_ctx
+{
+	unsigned char	st[33][MK_HASHLEN];	/* subtree roots, largest first */
+	int		sp;
+	unsigned long	n;			/* leaves added */
+} mk_ctx;
+
+void mk_hash(unsigned char *h, const void *buf, unsigned int len);
+int mk_leaf(FILE *f, unsigned long leaf, const void *buf, unsigned int len);
+int mk_changed(FILE *f, unsigned long leaf, const void *buf, unsigned int len);
+int mk_root(FILE *f, unsigned long nleaves, unsigned char root[MK_HASHLEN]);
+void mk_start(mk_ctx *c);
+void mk_add(mk_ctx *c, const unsigned char *leaf);
+void mk_end(mk_ctx *c, unsigned char root[MK_HASHLEN]);
+
+#endif
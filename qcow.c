@@ -0,0 +1,294 @@
+/* qcow.c - qcow2 image writer.
+ * File layout: header cluster, L1 table, then L2 tables and data clusters
+ * in the order they were needed, then the refcount blocks and the
+ * refcount table, written on close. Nothing is ever freed, so every
+ * cluster before the refcounts is used exactly once; a resumed copy
+ * writes new clusters over the old refcounts, so until it is closed the
+ * header points at none (the image is not valid for QEMU meanwhile).
+ * A cluster is written before the L2 entry pointing to it, and an L2
+ * table before its L1 entry, so after a crash the tables on disk still
+ * describe every cluster written; a resumed copy rebuilds the end of the
+ * data from them rather than trusting refcounts that may be overwritten.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __MSDOS__
+#include <io.h>
+#else
+#include <unistd.h>
+#define O_BINARY	0
+#endif
+#include "qcow.h"
+
+#define HDRLEN		72			/* version 2 header */
+#define RC_PER		(QC_SIZE/2)		/* 16 bit refcounts per block */
+#define COPIED		0x80			/* entry flag: refcount is 1 */
+
+static void put32be(unsigned char *p, unsigned long v)
+{
+	p[0]=(unsigned char)(v>>24);
+	p[1]=(unsigned char)(v>>16);
+	p[2]=(unsigned char)(v>>8);
+	p[3]=(unsigned char)v;
+}
+
+static unsigned long get32be(const unsigned char *p)
+{
+	return ((unsigned long)p[0]<<24)|((unsigned long)p[1]<<16)|((unsigned long)p[2]<<8)|p[3];
+}
+
+/* L1/L2 entry: 64 bit offset, files stay below 4 GB */
+static void put_entry(unsigned char *p, unsigned long off)
+{
+	memset(p,0,8);
+	p[0]=COPIED;
+	put32be(p+4,off);
+}
+
+static int rw(qcowout *q, unsigned long off, void *buf, unsigned int n, int wr)
+{
+	if(lseek(q->fh,(long)off,SEEK_SET)<0)
+		return -1;
+	if(wr)
+		return write(q->fh,buf,n)==n?0:-1;
+	return read(q->fh,buf,n)==n?0:-1;
+}
+
+static int iszero(const char *p, unsigned int n)
+{
+	while(n>0 && *p==0)
+	{
+		p++;
+		n--;
+	}
+	return n==0;
+}
+
+static int l2_load(qcowout *q, unsigned int i)
+{
+	if((long)i==q->l2idx)
+		return 0;
+	q->l2idx=-1;
+	if(q->l1[i]==0)
+		memset(q->l2,0,QC_SIZE);
+	else if(rw(q,q->l1[i],q->l2,QC_SIZE,0)!=0)
+		return -1;
+	q->l2idx=i;
+	return 0;
+}
+
+/* an L1 or L2 entry read back: 0, or a cluster after the L1 table that
+ * lies within the file; returns its offset, or 1 if it is not valid */
+static unsigned long entry(const unsigned char *e, unsigned long size)
+{
+	unsigned long off=get32be(e+4);
+	if(get32be(e)==0 && off==0)
+		return 0;
+	if(get32be(e)!=(unsigned long)COPIED<<24 || off%QC_SIZE!=0 ||
+		off<2L*QC_SIZE || off>size-QC_SIZE)
+		return 1;
+	return off;
+}
+
+/* header cluster; size is in sectors, may be past 4 GB */
+static int header(qcowout *q, unsigned long rt, unsigned long rtn)
+{
+	memset(q->cbuf,0,QC_SIZE);
+	memcpy(q->cbuf,"QFI\373",4);
+	put32be(q->cbuf+4,2);
+	put32be(q->cbuf+20,QC_BITS);
+	put32be(q->cbuf+24,q->sectors>>23);
+	put32be(q->cbuf+28,(q->sectors<<9)&0xffffffffUL);
+	put32be(q->cbuf+36,q->l1size);
+	put32be(q->cbuf+44,q->l1off);
+	put32be(q->cbuf+52,rt);
+	put32be(q->cbuf+56,rtn);
+	return rw(q,0,q->cbuf,QC_SIZE,1);
+}
+
+/* pick up an image written before; only the layout above is accepted.
+ * The end of the data is found from the L1 and L2 tables */
+static int load(qcowout *q)
+{
+	unsigned char *h=q->cbuf;
+	unsigned long size, off;
+	unsigned int i, j;
+	long fs;
+	if(rw(q,0,h,HDRLEN,0)!=0 || memcmp(h,"QFI\373",4)!=0 || get32be(h+4)!=2 ||
+		get32be(h+8)!=0 || get32be(h+12)!=0 || get32be(h+20)!=QC_BITS ||
+		get32be(h+24)!=q->sectors>>23 || get32be(h+28)!=((q->sectors<<9)&0xffffffffUL) ||
+		get32be(h+32)!=0 || get32be(h+36)!=q->l1size || get32be(h+40)!=0 ||
+		get32be(h+44)!=QC_SIZE || get32be(h+60)!=0)
+		return -1;
+	if((fs=lseek(q->fh,0L,SEEK_END))<2L*QC_SIZE)
+		return -1;
+	size=(unsigned long)fs;
+	q->l1off=QC_SIZE;
+	q->end=2L*QC_SIZE;
+	if(rw(q,q->l1off,h,q->l1size*8,0)!=0)
+		return -1;
+	for(i=0;i<q->l1size;i++)
+		if((q->l1[i]=entry(h+8*i,size))==1)
+			return -1;
+	for(i=0;i<q->l1size;i++)
+	{
+		if(q->l1[i]==0)
+			continue;
+		if(q->l1[i]>=q->end)
+			q->end=q->l1[i]+QC_SIZE;
+		if(l2_load(q,i)!=0)
+			return -1;
+		for(j=0;j<QC_L2;j++)
+		{
+			if((off=entry(q->l2+8*j,size))==1)
+				return -1;
+			if(off>=q->end)
+				q->end=off+QC_SIZE;
+		}
+	}
+	return header(q,0,0);	/* the old refcounts are about to go */
+}
+
+/* keep=1 writes into an existing image (resumed or updated copy) */
+int qcow_open(qcowout *q, const char *fn, unsigned long sectors, int keep)
+{
+	memset(q,0,sizeof(qcowout));
+	q->sectors=sectors;
+	q->l2idx=-1;
+	q->l1size=(unsigned int)((sectors+(unsigned long)QC_SECT*QC_L2-1)/((unsigned long)QC_SECT*QC_L2));
+	if(q->l1size>QC_L2)	/* L1 in one cluster: 512 GB */
+		return -1;
+	q->l1=calloc(q->l1size,sizeof(unsigned long));
+	q->l2=malloc(QC_SIZE);
+	q->cbuf=malloc(QC_SIZE);
+	if(q->l1==NULL || q->l2==NULL || q->cbuf==NULL)
+		return -1;
+	if(keep)
+	{
+		if((q->fh=open(fn,O_BINARY|O_RDWR))<1)
+			return -1;
+		return load(q);
+	}
+	if((q->fh=open(fn,O_CREAT|O_TRUNC|O_BINARY|O_RDWR,S_IREAD|S_IWRITE))<1)
+		return -1;
+	q->l1off=QC_SIZE;
+	q->end=2L*QC_SIZE;
+	/* refcounts come on close, but the clusters must not be left as
+	 * holes: DOS would not zero them */
+	if(header(q,0,0)!=0)
+		return -1;
+	memset(q->cbuf,0,QC_SIZE);
+	return rw(q,q->l1off,q->cbuf,QC_SIZE,1);
+}
+
+/* write the refcounts after the data and point the header at them */
+static int refcounts(qcowout *q)
+{
+	unsigned long used, n, rb=0, rt=0, nb, nt, i;
+	unsigned int j;
+	int res=0;
+
+	/* the refcount blocks and table count themselves too */
+	used=q->end>>QC_BITS;
+	for(;;)
+	{
+		n=used+rb+rt;
+		nb=(n+RC_PER-1)/RC_PER;
+		nt=(nb*8+QC_SIZE-1)/QC_SIZE;
+		if(nb==rb && nt==rt)
+			break;
+		rb=nb;
+		rt=nt;
+	}
+	for(i=0;i<rb && res==0;i++)
+	{
+		memset(q->cbuf,0,QC_SIZE);
+		for(j=0;j<RC_PER && i*RC_PER+j<n;j++)
+			q->cbuf[2*j+1]=1;
+		res|=rw(q,q->end+i*QC_SIZE,q->cbuf,QC_SIZE,1);
+	}
+	for(i=0;i<rb && res==0;i++)
+	{
+		if(i%QC_L2==0)
+			memset(q->cbuf,0,QC_SIZE);
+		put32be(q->cbuf+(unsigned int)(i%QC_L2)*8+4,q->end+i*QC_SIZE);
+		if(i%QC_L2==QC_L2-1 || i==rb-1)
+			res|=rw(q,q->end+(rb+i/QC_L2)*QC_SIZE,q->cbuf,QC_SIZE,1);
+	}
+	if(res==0)
+		res=header(q,q->end+rb*QC_SIZE,rt);
+	return res;
+}
+
+/* write n sectors at lba */
+int qcow_write(qcowout *q, unsigned long lba, const char *buf, unsigned int n)
+{
+	unsigned long c, off;
+	unsigned int in, k;
+	unsigned char *e, le[8];
+
+	while(n>0)
+	{
+		c=lba/QC_SECT;
+		in=(unsigned int)(lba%QC_SECT);
+		k=QC_SECT-in;
+		if(k>n)
+			k=n;
+		if(l2_load(q,(unsigned int)(c/QC_L2))!=0)
+			return -1;
+		e=q->l2+(unsigned int)(c%QC_L2)*8;
+		off=get32be(e+4);
+		if(off!=0)
+		{
+			if(rw(q,off+in*512UL,(char *)buf,k*512,1)!=0)
+				return -1;
+		}
+		else if(!iszero(buf,k*512))	/* new cluster, the rest of it is zeros */
+		{
+			if(q->l1[(unsigned int)q->l2idx]==0)	/* new L2 table, all zeros */
+			{
+				put_entry(le,q->end);
+				if(rw(q,q->end,q->l2,QC_SIZE,1)!=0 ||
+					rw(q,q->l1off+(unsigned long)q->l2idx*8,le,8,1)!=0)
+					return -1;
+				q->l1[(unsigned int)q->l2idx]=q->end;
+				q->end+=QC_SIZE;
+			}
+			memset(q->cbuf,0,QC_SIZE);
+			memcpy(q->cbuf+in*512,buf,k*512);
+			if(rw(q,q->end,q->cbuf,QC_SIZE,1)!=0)
+				return -1;
+			put_entry(e,q->end);
+			if(rw(q,q->l1[(unsigned int)q->l2idx]+(c%QC_L2)*8,e,8,1)!=0)
+				return -1;
+			q->end+=QC_SIZE;
+		}
+		buf+=k*512;
+		lba+=k;
+		n-=k;
+	}
+	return 0;
+}
+
+/* write out the refcounts; the image is consistent afterwards */
+int qcow_close(qcowout *q)
+{
+	int res;
+
+	if(q->fh<1)
+		return 0;
+	res=refcounts(q);
+	if(close(q->fh)!=0)
+		res=-1;
+	q->fh=0;
+	free(q->l1);
+	free(q->l2);
+	free(q->cbuf);
+	return res;
+}
@@ -0,0 +1,32 @@
+/* qcow.h - qcow2 image writer, so QEMU can boot a copy as it is.
+ * Version 2 images with 32 KB clusters; clusters are only allocated for
+ * data that is not all zeros. Tracks may come in any order, and a
+ * resumed or updated copy writes into the existing image.
+ */
+
+#ifndef QCOW_H
+#define QCOW_H
+
+#define QC_BITS		15			/* cluster size 32 KB */
+#define QC_SIZE		(1U<<QC_BITS)
+#define QC_SECT		(QC_SIZE/512)		/* sectors per cluster */
+#define QC_L2		(QC_SIZE/8)		/* entries per L2 table */
+
+typedef struct qcowout
+{
+	int		fh;
+	unsigned long	sectors;	/* size of the drive */
+	unsigned long	*l1;		/* file offsets of L2 tables, 0 if none */
+	unsigned int	l1size;
+	unsigned long	l1off;
+	unsigned char	*l2;		/* cached L2 table, as in the file */
+	long		l2idx;		/* its L1 index, -1 if none */
+	unsigned char	*cbuf;		/* cluster being written */
+	unsigned long	end;		/* end of the data, next cluster to allocate */
+} qcowout;
+
+int qcow_open(qcowout *q, const char *fn, unsigned long sectors, int keep);
+int qcow_write(qcowout *q, unsigned long lba, const char *buf, unsigned int n);
+int qcow_close(qcowout *q);
+
+#endif
@@ -0,0 +1,89 @@
+/* rawcat - write out any rawhdd image (stripe set, segments, frame file,
+ * E01, qcow2, encrypted) as one plain image.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __MSDOS__
+#include <io.h>
+#include <fcntl.h>
+#endif
+#include "rhimg.h"
+#include "aes.h"
+
+#define CHUNK	64	/* sectors per read */
+
+void print_usage()
+{
+	printf("Usage: rawcat [-e=keyfile] <image> [dst_file]\n");
+	printf("Writes image (plain file, stripe set manifest, segment index, file written\n");
+	printf("by -o=frame, E01, qcow2 or, with its key file, -o=aes) as one plain image\n");
+	printf("to dst_file, or to standard output.\n");
+}
+
+int main(int argc,char *argv[])
+{
+	rhimg im;
+	FILE *out=stdout;
+	char *buf;
+	unsigned long lba;
+	unsigned int n;
+	unsigned char key[AES_KEYLEN];
+
+	if(argc>1 && strncmp(argv[1],"-e=",3)==0)
+	{
+		if(aes_keyfile(argv[1]+3,key)!=0)
+		{
+			fprintf(stderr,"Unable to read key file %s\n",argv[1]+3);
+			return 2;
+		}
+		img_key(key);
+		argc--;
+		argv++;
+	}
+	if(argc<2 || argc>3 || argv[1][0]=='-')
+	{
+		print_usage();
+		return 2;
+	}
+	if(img_open(&im,argv[1])!=0)
+	{
+		fprintf(stderr,"Unable to open image %s\n",argv[1]);
+		return 2;
+	}
+	if(argc==3 && (out=fopen(argv[2],"wb"))==NULL)
+	{
+		fprintf(stderr,"Unable to create %s\n",argv[2]);
+		return 2;
+	}
+#ifdef __MSDOS__
+	if(out==stdout)
+		setmode(fileno(stdout),O_BINARY);
+#endif
+	if((buf=malloc(CHUNK*512))==NULL)
+	{
+		fprintf(stderr,"malloc failed\n");
+		return 2;
+	}
+	for(lba=0;lba<im.sectors;lba+=n)
+	{
+		n=im.sectors-lba<CHUNK?(unsigned int)(im.sectors-lba):CHUNK;
+		if(img_read(&im,lba,n,buf)!=0)
+		{
+			fprintf(stderr,"Error reading image at LBA %lu\n",lba);
+			return 1;
+		}
+		if(fwrite(buf,512,n,out)!=n)
+		{
+			fprintf(stderr,"Write error\n");
+			return 1;
+		}
+	}
+	img_close(&im);
+	free(buf);
+	return fclose(out)==0?0:1;
+}
@@ -0,0 +1,223 @@
+/* rawconv - convert a rawhdd image to other formats.
+ * Reads any image rhimg.c opens and writes it through the same writers
+ * rawhdd uses (rhdest.c), to one or more destinations in one pass:
+ *	rawconv DISK.FRM -o=qcow2 DISK.QCW -o=ewf DISK.E01
+ * All-zero tracks are left as holes in raw outputs (except under DOS,
+ * where FAT fills a gap seeked over with whatever the clusters held); the
+ * other formats already store them as zero frames, zero chunks or
+ * unallocated clusters.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rhimg.h"
+#include "rhdest.h"
+#include "aes.h"
+
+dest dst[MAXDST];
+int ndst=0;
+
+void print_usage()
+{
+	printf("Usage: rawconv [-c=C,H,S] [-e=keyfile] <image> [-o=raw|frame|stripe|seg|ewf|\n");
+	printf("               qcow2|aes] [-g=MB] [-z=1|a] [-b=KB/s] <dst_file> [[-o=..] dst_file]...\n");
+	printf("-c=C,H,S geometry of the output, when the image does not record one\n");
+	printf("-e=keyfile key of an encrypted image and of -o=aes outputs\n");
+	printf("Other switches as for rawhdd; they apply to the destinations after them.\n");
+}
+
+/* largest divisor of n not above max */
+unsigned int divisor(unsigned long n, unsigned int max)
+{
+	while(max>1 && n%max!=0)
+		max--;
+	return max;
+}
+
+int iszero(const char *p, unsigned int n)
+{
+	while(n>0 && *p==0)
+	{
+		p++;
+		n--;
+	}
+	return n==0;
+}
+
+int main(int argc,char *argv[])
+{
+	rhimg im;
+	char *src=NULL, *buf, *a;
+	int format=FMT_RAW, lz=0, segmb=2047, i, res=0;
+	unsigned long rate=0;
+	unsigned int c=0, h=0, s=0;
+	unsigned long trk, tracks, zero=0;
+	unsigned char key[AES_KEYLEN];
+
+	for(i=1;i<argc;i++)
+	{
+		a=argv[i];
+		if(a[0]!='-')
+		{
+			if(src==NULL)
+				src=a;
+			else if(ndst==MAXDST || dst_init(&dst[ndst],a,format,lz)!=0)
+			{
+				print_usage();
+				return 2;
+			}
+			else
+			{
+				dst[ndst].segsize=(unsigned long)segmb<<20;
+				dst[ndst++].rate=rate;
+			}
+			continue;
+		}
+		if(strlen(a)<4 || a[2]!='=')
+			a="-?=";
+		switch(a[1])
+		{
+			case 'c':
+				if(sscanf(a+3,"%u,%u,%u",&c,&h,&s)!=3 || c==0 || h==0 || s==0 || s>63)
+					a="-?=";
+				break;
+			case 'o':
+				if(strcmp(a+3,"raw")==0)
+					format=FMT_RAW;
+				else if(strcmp(a+3,"frame")==0)
+					format=FMT_FRAME;
+				else if(strcmp(a+3,"stripe")==0)
+					format=FMT_STRIPE;
+				else if(strcmp(a+3,"seg")==0)
+					format=FMT_SEG;
+				else if(strcmp(a+3,"ewf")==0)
+					format=FMT_EWF;
+				else if(strcmp(a+3,"qcow2")==0)
+					format=FMT_QCOW;
+				else if(strcmp(a+3,"aes")==0)
+					format=FMT_AES;
+				else
+					a="-?=";
+				break;
+			case 'e':
+				if(aes_keyfile(a+3,key)!=0)
+				{
+					printf("Unable to read key file %s\n",a+3);
+					return 2;
+				}
+				img_key(key);
+				dst_key(key);
+				break;
+			case 'z':
+				lz=a[3]=='a'?LZ_AUTO:atoi(a+3);
+				break;
+			case 'b':
+				rate=(unsigned long)atol(a+3);
+				break;
+			case 'g':
+				segmb=atoi(a+3);
+				if(segmb<1 || segmb>2047)
+					a="-?=";
+				break;
+			default:
+				a="-?=";
+		}
+		if(a[1]=='?')
+		{
+			print_usage();
+			return 2;
+		}
+	}
+	if(src==NULL || ndst==0)
+	{
+		print_usage();
+		return 2;
+	}
+	if(img_open(&im,src)!=0)
+	{
+		printf("Unable to open image %s\n",src);
+		return 2;
+	}
+
+	/* geometry: given, recorded in the image, or made up so that
+	 * tracks cover the image exactly */
+	if(c==0 && (unsigned long)im.cyls*im.heads*im.spt==im.sectors && im.sectors>0)
+	{
+		c=im.cyls;
+		h=im.heads;
+		s=im.spt;
+	}
+	if(c==0)
+	{
+		s=divisor(im.sectors,63);
+		h=divisor(im.sectors/s,255);
+		if(im.sectors/s/h>65535U)
+		{
+			printf("Image geometry unknown, give it with -c=C,H,S\n");
+			return 2;
+		}
+		c=(unsigned int)(im.sectors/s/h);
+	}
+	tracks=(unsigned long)c*h;
+	if(tracks*s>im.sectors)
+	{
+		printf("Geometry %u,%u,%u is larger than the image\n",c,h,s);
+		return 2;
+	}
+	printf("%s: %lu sectors, CHS %u,%u,%u\n",src,im.sectors,c,h,s);
+	if(tracks*s<im.sectors)
+		printf("The last %lu sectors are past the geometry and are left out\n",im.sectors-tracks*s);
+	dst_geometry(c,h,s);
+	if((buf=malloc(512*s))==NULL)
+	{
+		printf("malloc failed\n");
+		return 2;
+	}
+	for(i=0;i<ndst;i++)
+		if(dst_open(&dst[i],0)!=0)
+		{
+			printf("Unable to create %s\n",dst[i].fn);
+			return 2;
+		}
+
+	for(trk=0;trk<tracks && res==0;trk++)
+	{
+		if(img_read(&im,trk*s,s,buf)!=0)
+		{
+			printf("\nError reading image at LBA %lu\n",trk*s);
+			res=1;
+			break;
+		}
+		if(iszero(buf,512*s))
+			zero++;
+		for(i=0;i<ndst;i++)
+		{
+#ifndef __MSDOS__
+			/* hole, but the last track sets the file size */
+			if(dst[i].format==FMT_RAW && trk<tracks-1 && iszero(buf,512*s))
+				continue;
+#endif
+			if(dst_track(&dst[i],trk,buf,NULL)!=0)
+			{
+				printf("\nError writing %s\n",dst[i].fn);
+				res=1;
+			}
+		}
+		if(trk%(h*16UL)==0)
+			printf("\rCylinder %lu of %u",trk/h,c);
+	}
+	printf("\rCylinder %u of %u, %lu tracks all zeros\n",res?(unsigned int)(trk/h):c,c,zero);
+	for(i=0;i<ndst;i++)
+		if(dst_close(&dst[i],res==0)!=0)
+		{
+			printf("Error closing %s\n",dst[i].fn);
+			res=1;
+		}
+	img_close(&im);
+	free(buf);
+	return res;
+}
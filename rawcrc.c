@@ -0,0 +1,195 @@
+/* rawcrc - check a rawhdd image against its CRC-32C sidecar (.CRC).
+ * Reports ranges of blocks (tracks) whose data no longer matches, e.g.
+ * after copying an image between storage tiers. -f and -n select a range
+ * of blocks, so that several instances can check one image in parallel.
+ * Given the index of a segmented image (rawhdd -o=seg), checks each
+ * segment against the CRC in the index instead.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crc32c.h"
+#include "rhmap.h"
+
+void print_usage()
+{
+	printf("Usage: rawcrc [-f=first_block] [-n=blocks] <image>\n");
+	printf("Checks image against the CRC-32C of each block stored in image.CRC\n");
+	printf("(written by rawhdd -k=1). A block is one track of the source drive.\n");
+	printf("If image is the index of a segmented image (rawhdd -o=seg), its segments\n");
+	printf("are checked against the CRCs in the index.\n");
+}
+
+/* check the segments listed in an index; returns number of bad ones */
+unsigned long check_segs(FILE *xf, const char *fn, unsigned long *nseg)
+{
+	char line[128], name[NAMELEN], ext[8], crc[16];
+	char *buf;
+	FILE *f;
+	unsigned long seg=0, size, n, c, nbad=0;
+	unsigned int k;
+
+	if((buf=malloc(0x8000U))==NULL)
+		return 1;
+	while(fgets(line,sizeof(line),xf)!=NULL)
+	{
+		if(strncmp(line,"CHS ",4)==0 || strncmp(line,"SEGMENT ",8)==0 ||
+			sscanf(line,"%79s %lu %15s",name,&size,crc)!=3)
+			continue;
+		sprintf(ext,"%03lu",seg++);
+		if(sidecar(name,sizeof(name),fn,ext)!=0)
+		{
+			nbad++;
+			break;
+		}
+		if(strcmp(crc,"-")==0)
+		{
+			printf("%s: no CRC (copy was not finished)\n",name);
+			continue;
+		}
+		if((f=fopen(name,"rb"))==NULL)
+		{
+			printf("BAD: %s is missing\n",name);
+			nbad++;
+			continue;
+		}
+		c=0;
+		for(n=0;n<size;n+=k)
+		{
+			k=size-n<0x8000UL?(unsigned int)(size-n):0x8000U;
+			if(fread(buf,k,1,f)!=1)
+				break;
+			c=crc32c(c,buf,k);
+		}
+		fclose(f);
+		if(n<size)
+			printf("BAD: %s is shorter than %lu bytes\n",name,size);
+		else if(c!=strtoul(crc,NULL,16))
+			printf("BAD: %s (CRC %08lX, index says %s)\n",name,c,crc);
+		else
+			continue;
+		nbad++;
+	}
+	free(buf);
+	*nseg=seg;
+	return nbad;
+}
+
+/* print a range of bad blocks */
+void report(unsigned long first, unsigned long last, unsigned long bsize)
+{
+	printf("BAD: blocks %lu-%lu (bytes %lu-%lu)\n",first,last,
+		first*bsize,(last+1)*bsize-1);
+}
+
+int main(int argc,char *argv[])
+{
+	char *fn=NULL;
+	char crcname[NAMELEN];
+	FILE *img, *cf;
+	unsigned char hdr[CRC_HDRLEN];
+	unsigned char c[4];
+	unsigned long first=0, count=0xffffffffUL;
+	unsigned long bsize, blk, nbad=0, nblk=0;
+	unsigned long badstart=0;
+	int inbad=0;
+	char *buf;
+	int i;
+
+	for(i=1;i<argc;i++)
+	{
+		if(argv[i][0]!='-')
+		{
+			if(fn!=NULL)
+			{
+				print_usage();
+				return 2;
+			}
+			fn=argv[i];
+		}
+		else if(strncmp(argv[i],"-f=",3)==0)
+			first=atol(argv[i]+3);
+		else if(strncmp(argv[i],"-n=",3)==0)
+			count=atol(argv[i]+3);
+		else
+		{
+			print_usage();
+			return 2;
+		}
+	}
+	if(fn==NULL)
+	{
+		print_usage();
+		return 2;
+	}
+	if((img=fopen(fn,"rb"))!=NULL && fgets(crcname,sizeof(crcname),img)!=NULL &&
+		strncmp(crcname,"RAWHDD SEGMENTS",15)==0)
+	{
+		nbad=check_segs(img,fn,&nblk);
+		printf("%lu segments checked, %lu bad\n",nblk,nbad);
+		fclose(img);
+		return nbad?1:0;
+	}
+	if(img!=NULL)
+		fclose(img);
+	if(sidecar(crcname,sizeof(crcname),fn,"CRC")!=0)
+		return 2;
+	img=fopen(fn,"rb");
+	cf=fopen(crcname,"rb");
+	if(img==NULL || cf==NULL)
+	{
+		printf("Unable to open %s\n",img==NULL?fn:crcname);
+		return 2;
+	}
+	if(fread(hdr,CRC_HDRLEN,1,cf)!=1 || memcmp(hdr,"RHC1",4)!=0)
+	{
+		printf("%s is not a rawhdd CRC file\n",crcname);
+		return 2;
+	}
+	bsize=get32le(hdr+4);
+	if(bsize==0 || bsize>0xfff0UL || (buf=malloc((unsigned int)bsize))==NULL)
+	{
+		printf("Unsupported block size %lu\n",bsize);
+		return 2;
+	}
+	if(fseek(img,(long)(first*bsize),SEEK_SET)!=0 || fseek(cf,(long)(CRC_HDRLEN+first*4),SEEK_SET)!=0)
+	{
+		printf("Block %lu is out of range\n",first);
+		return 2;
+	}
+	for(blk=first;blk-first<count;blk++)
+	{
+		if(fread(c,4,1,cf)!=1)
+			break;
+		if(fread(buf,(unsigned int)bsize,1,img)!=1)
+		{
+			printf("Image is shorter than the CRC file (%lu blocks)\n",blk);
+			nbad++;
+			break;
+		}
+		nblk++;
+		if(crc32c(0,buf,(unsigned int)bsize)!=get32le(c))
+		{
+			nbad++;
+			if(!inbad)
+				badstart=blk;
+			inbad=1;
+		}
+		else if(inbad)
+		{
+			report(badstart,blk-1,bsize);
+			inbad=0;
+		}
+	}
+	if(inbad)
+		report(badstart,blk-1,bsize);
+	printf("%lu blocks checked, %lu bad\n",nblk,nbad);
+	free(buf);
+	fclose(img);
+	fclose(cf);
+	return nbad?1:0;
+}
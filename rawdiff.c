@@ -0,0 +1,86 @@
+/* rawdiff - compare two images of the same drive.
+ * Instead of the first differing byte (like cmp), lists every run of
+ * differing sectors plus summary statistics. Used to check what re-imaging
+ * (rawhdd -u) or rawmerge actually changed.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rhmap.h"
+
+#define CHUNK	64	/* sectors compared per read */
+
+void print_usage()
+{
+	printf("Usage: rawdiff <image1> <image2>\n");
+	printf("Lists runs of 512 byte sectors (LBA ranges) that differ between the images.\n");
+	printf("Exit status is 0 if images are identical, 1 if they differ, 2 on error.\n");
+}
+
+int main(int argc,char *argv[])
+{
+	FILE *a, *b;
+	char *ba, *bb;
+	unsigned int na, nb, n, i;
+	unsigned long lba=0, chunks=0, same=0;
+	long la, lb;
+	rhext diff;
+
+	if(argc!=3 || argv[1][0]=='-' || argv[2][0]=='-')
+	{
+		print_usage();
+		return 2;
+	}
+	a=fopen(argv[1],"rb");
+	b=fopen(argv[2],"rb");
+	if(a==NULL || b==NULL)
+	{
+		printf("Unable to open %s\n",a==NULL?argv[1]:argv[2]);
+		return 2;
+	}
+	ba=malloc(CHUNK*512);
+	bb=malloc(CHUNK*512);
+	if(ba==NULL || bb==NULL)
+	{
+		printf("malloc failed\n");
+		return 2;
+	}
+	ext_init(&diff,"DIFF",NULL);
+	for(;;)
+	{
+		na=fread(ba,1,CHUNK*512,a);
+		nb=fread(bb,1,CHUNK*512,b);
+		n=na<nb?na:nb;
+		if(n==0)
+			break;
+		chunks++;
+		if(memcmp(ba,bb,n)==0)	/* the usual case */
+		{
+			same++;
+			lba+=(n+511)/512;
+		}
+		else for(i=0;i<n;i+=512,lba++)
+			if(memcmp(ba+i,bb+i,n-i<512?n-i:512)!=0)
+				ext_add(&diff,lba);
+		if(n<CHUNK*512)	/* (at least) one image ended */
+			break;
+	}
+	ext_flush(&diff);
+	fseek(a,0L,SEEK_END);
+	fseek(b,0L,SEEK_END);
+	la=ftell(a);
+	lb=ftell(b);
+	printf("%lu of %lu chunks identical, %lu sectors differ in %lu runs\n",
+		same,chunks,diff.total,diff.runs);
+	if(la!=lb)
+		printf("Sizes differ: %s has %ld bytes, %s has %ld bytes\n",argv[1],la,argv[2],lb);
+	fclose(a);
+	fclose(b);
+	free(ba);
+	free(bb);
+	return (diff.total || la!=lb)?1:0;
+}
@@ -0,0 +1,142 @@
+/* rawent - list the entropy map (.ENT) written by rawhdd -n=1.
+ * Consecutive tracks of the same kind are shown as one region, so
+ * encrypted volumes and archives (close to 8 bits per byte) stand out
+ * from file systems, text and empty space.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "crc32c.h"
+#include "entropy.h"
+#include "rhmap.h"
+
+#define NKIND	5
+
+static const char *kinds[NKIND]={
+	"not copied",
+	"blank (one byte value)",
+	"structured (text, code, tables)",
+	"dense (media, mixed)",
+	"random (encrypted or compressed)"
+};
+
+void print_usage()
+{
+	printf("Usage: rawent [-v=1] <image>\n");
+	printf("Lists regions of image by the entropy of their tracks, as stored in\n");
+	printf("image.ENT (written by rawhdd -n=1). -v=1 lists every track.\n");
+}
+
+int kind(int e)
+{
+	if(e==0)
+		return 0;
+	e--;
+	if(e==0)
+		return 1;
+	if(e<6*ENT_ONE)
+		return 2;
+	if(e<=ENT_NOPACK)
+		return 3;
+	return 4;
+}
+
+/* print a region of tracks and the average entropy of its copied ones */
+void report(unsigned long first, unsigned long last, unsigned long spt, int k, unsigned long sum)
+{
+	printf("tracks %lu-%lu (LBA %lu-%lu) ",first,last,first*spt,(last+1)*spt-1);
+	if(k>0)
+		printf("%lu.%02lu bits/byte, ",sum/(last-first+1)/ENT_ONE,
+			sum/(last-first+1)%ENT_ONE*100/ENT_ONE);
+	printf("%s\n",kinds[k]);
+}
+
+int main(int argc,char *argv[])
+{
+	char *fn=NULL;
+	char entname[NAMELEN];
+	FILE *f;
+	unsigned char hdr[ENT_HDRLEN];
+	unsigned long spt, trk, first=0, sum=0;
+	unsigned long count[NKIND];
+	int verbose=0, i, c, k, cur=-1;
+
+	for(i=1;i<argc;i++)
+	{
+		if(argv[i][0]!='-')
+		{
+			if(fn!=NULL)
+			{
+				print_usage();
+				return 2;
+			}
+			fn=argv[i];
+		}
+		else if(strncmp(argv[i],"-v=",3)==0)
+			verbose=atoi(argv[i]+3);
+		else
+		{
+			print_usage();
+			return 2;
+		}
+	}
+	if(fn==NULL)
+	{
+		print_usage();
+		return 2;
+	}
+	if(sidecar(entname,sizeof(entname),fn,"ENT")!=0)
+		return 2;
+	if((f=fopen(entname,"rb"))==NULL)
+	{
+		printf("Unable to open %s\n",entname);
+		return 2;
+	}
+	if(fread(hdr,ENT_HDRLEN,1,f)!=1 || memcmp(hdr,"RHE1",4)!=0 ||
+		(spt=get32le(hdr+4)/512)==0)
+	{
+		printf("%s is not a rawhdd entropy file\n",entname);
+		return 2;
+	}
+	for(k=0;k<NKIND;k++)
+		count[k]=0;
+	for(trk=0;(c=fgetc(f))!=EOF;trk++)
+	{
+		k=kind(c);
+		count[k]++;
+		if(verbose)
+		{
+			printf("track %lu: ",trk);
+			if(c>0)
+				printf("%u.%02u ",(c-1)/ENT_ONE,(c-1)%ENT_ONE*100/ENT_ONE);
+			printf("%s\n",kinds[k]);
+			continue;
+		}
+		if(k!=cur)
+		{
+			if(cur>=0)
+				report(first,trk-1,spt,cur,sum);
+			cur=k;
+			first=trk;
+			sum=0;
+		}
+		if(c>0)
+			sum+=c-1;
+	}
+	if(cur>=0)
+		report(first,trk-1,spt,cur,sum);
+	fclose(f);
+	printf("%lu tracks",trk);
+	for(k=0,c=':';k<NKIND;k++)
+		if(count[k])
+		{
+			printf("%c %lu %s",c,count[k],kinds[k]);
+			c=';';
+		}
+	printf("\n");
+	return 0;
+}
@@ -0,0 +1,172 @@
+/* rawgrep - search any rawhdd image for words, ASCII or UTF-16LE, case
+ * insensitive. With the trigram index written by rawhdd -t=1 (.TRI) only
+ * the tracks that may hold a word are read; without it, all of them.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rhimg.h"
+#include "rhmap.h"
+#include "crc32c.h"
+#include "trigram.h"
+#include "aes.h"
+
+#define MAXWORD		16
+#define WORDLEN		64
+#define BLOCK		64	/* sectors per read without an index */
+
+char word[MAXWORD][WORDLEN+1];
+int nword=0;
+
+void print_usage()
+{
+	printf("Usage: rawgrep [-e=keyfile] <image> word [word]...\n");
+	printf("Lists the LBA and offset of each word found in image (any format rawcat\n");
+	printf("reads), as ASCII or UTF-16LE text, ignoring case. If image.TRI exists\n");
+	printf("(rawhdd -t=1), only tracks whose index allows a word are read; a word under\n");
+	printf("%d characters, or not all printable ASCII, reads every track. Words split\n",TRI_MINRUN);
+	printf("between two tracks are not found.\n");
+}
+
+/* word w at p, as bytes (step 1) or UTF-16LE (step 2) */
+int match(const unsigned char *p, const char *w, unsigned int step)
+{
+	for(;*w;w++,p+=step)
+		if(tri_fold(*p)!=*w || (step==2 && p[1]!=0))
+			return 0;
+	return 1;
+}
+
+/* search one block for the words marked in want; returns hits */
+unsigned long search(const unsigned char *buf, unsigned int len, unsigned long lba, const int *want)
+{
+	unsigned long hits=0;
+	unsigned int i, n;
+	int k;
+	for(k=0;k<nword;k++)
+	{
+		if(!want[k])
+			continue;
+		n=strlen(word[k]);
+		for(i=0;i+n<=len;i++)
+		{
+			if(match(buf+i,word[k],1))
+				printf("LBA %lu offset %u: %s\n",lba+i/512,i%512,word[k]);
+			else if(i+2*n<=len && match(buf+i,word[k],2))
+				printf("LBA %lu offset %u: %s (UTF-16)\n",lba+i/512,i%512,word[k]);
+			else
+				continue;
+			hits++;
+		}
+	}
+	return hits;
+}
+
+int main(int argc,char *argv[])
+{
+	rhimg im;
+	char triname[NAMELEN];
+	FILE *tf=NULL;
+	unsigned char hdr[TRI_HDRLEN], key[AES_KEYLEN];
+	unsigned char *buf, *bloom=NULL;
+	unsigned long lba, blocks=0, read=0, hits=0;
+	unsigned int spt=BLOCK, n, nb=0;
+	int want[MAXWORD], i, any;
+
+	if(argc>1 && strncmp(argv[1],"-e=",3)==0)
+	{
+		if(aes_keyfile(argv[1]+3,key)!=0)
+		{
+			printf("Unable to read key file %s\n",argv[1]+3);
+			return 2;
+		}
+		img_key(key);
+		argc--;
+		argv++;
+	}
+	if(argc<3 || argv[1][0]=='-' || argc-2>MAXWORD)
+	{
+		print_usage();
+		return 2;
+	}
+	for(i=2;i<argc;i++)
+	{
+		if(strlen(argv[i])==0 || strlen(argv[i])>WORDLEN)
+		{
+			printf("Words must have 1 to %d characters\n",WORDLEN);
+			return 2;
+		}
+		for(n=0;argv[i][n];n++)
+			word[nword][n]=(char)tri_fold((unsigned char)argv[i][n]);
+		word[nword++][n]=0;
+	}
+	if(img_open(&im,argv[1])!=0)
+	{
+		printf("Unable to open image %s\n",argv[1]);
+		return 2;
+	}
+	if(sidecar(triname,sizeof(triname),argv[1],"TRI")!=0)
+		return 2;
+	for(i=0;i<nword;i++)
+		if(!tri_indexed(word[i]))
+			break;
+	if(i<nword)	/* its tracks would all be read anyway */
+		printf("\"%s\" is not indexed (under %d characters or not printable ASCII),\n"
+			"reading every track\n",argv[i+2],TRI_MINRUN);
+	else if((tf=fopen(triname,"rb"))!=NULL)
+	{
+		if(fread(hdr,TRI_HDRLEN,1,tf)!=1 || memcmp(hdr,"RHT1",4)!=0 ||
+			get32le(hdr+4)%512!=0 || get32le(hdr+4)==0 || get32le(hdr+4)>0xfe00UL)
+		{
+			printf("%s is not a rawhdd trigram file\n",triname);
+			return 2;
+		}
+		spt=(unsigned int)(get32le(hdr+4)/512);
+		nb=TRI_BYTES(spt*512);
+		if((bloom=malloc(nb))==NULL)
+		{
+			printf("malloc failed\n");
+			return 2;
+		}
+	}
+	else
+		printf("No index (%s), reading every track\n",triname);
+	if((buf=malloc(spt*512))==NULL)
+	{
+		printf("malloc failed\n");
+		return 2;
+	}
+	for(lba=0;lba<im.sectors;lba+=n)
+	{
+		n=im.sectors-lba<spt?(unsigned int)(im.sectors-lba):spt;
+		blocks++;
+		for(i=0;i<nword;i++)
+			want[i]=1;
+		/* a missing filter (index shorter than the image) rules nothing out */
+		if(tf!=NULL && fread(bloom,nb,1,tf)==1)
+		{
+			for(i=0,any=0;i<nword;i++)
+				any|=want[i]=tri_maybe(bloom,nb,word[i]);
+			if(!any)
+				continue;
+		}
+		if(img_read(&im,lba,n,buf)!=0)
+		{
+			printf("Error reading image at LBA %lu\n",lba);
+			return 1;
+		}
+		read++;
+		hits+=search(buf,n*512,lba,want);
+	}
+	printf("%lu hits; %lu of %lu tracks read\n",hits,read,blocks);
+	if(tf!=NULL)
+		fclose(tf);
+	free(bloom);
+	free(buf);
+	img_close(&im);
+	return hits?0:1;
+}
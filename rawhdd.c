@@ -32,6 +32,16 @@
 #include <dos.h>
 #include <stdlib.h>
 #include <bios.h>
+#include <string.h>
+#include "rhmap.h"
+#include "merkle.h"
+#include "crc32c.h"
+#include "entropy.h"
+#include "sigscan.h"
+#include "trigram.h"
+#include "knownblk.h"
+#include "rhdest.h"
+#include "aes.h"
 
 /* BIOS table */
 typedef struct hddparam
@@ -51,6 +61,22 @@ typedef struct myopts
 	int	heads;
 	int	sectors;
 	int	drive;
+	char	*resume;	/* log to resume from, NULL if not resuming */
+	int	merkle;		/* keep Merkle tree leaf hashes */
+	int	crc;		/* keep CRC-32C of each track */
+	int	ent;		/* keep entropy of each track */
+	char	*sigs;		/* index file signatures: "1" or signature file */
+	int	tri;		/* keep trigram filter of each track */
+	char	*known;		/* known block database[,first sector of a block] */
+	int	blank;		/* leave known blocks out of the copy */
+	char	*status;	/* JSON status file */
+	int	verify;		/* compare drive with image instead of copying */
+	int	update;		/* rewrite only changed tracks of existing image */
+	int	format;		/* FMT_... for the destinations that follow */
+	int	lz;		/* compress them */
+	int	segmb;		/* segment size in MB for -o=seg */
+	char	*keyfile;	/* key for -o=aes */
+	unsigned long	rate;	/* write limit for the destinations that follow */
 	/* following are set to 1 if cyls/heads/sectors/drive is set */
 	int ts;
 	int hs;
@@ -68,13 +94,51 @@ unsigned int heads=0;
 unsigned char drive;
 unsigned int trackbytes;
 
-int dfh=0;	/* destination file handler */
+dest dst[MAXDST];	/* destinations, dst[0] is the image that is logged */
+int ndst=0;
+int dfh=0;	/* image file handler (verify) */
 FILE *lf=NULL;	/* log file */
+rhmap map;	/* tracks already copied (when resuming) */
+FILE *mkf=NULL;	/* Merkle tree leaf hashes */
+FILE *crcf=NULL;	/* per track CRC-32C */
+FILE *entf=NULL;	/* per track entropy */
+FILE *sigf=NULL;	/* file signatures found */
+unsigned long sighits=0;
+FILE *trif=NULL;	/* per track trigram filter */
+unsigned char *bloom=NULL;
+kbdb kb;	/* known blocks, kb.f is NULL if not used */
+int blank=0;	/* known blocks are not stored */
+FILE *knwf=NULL;	/* ranges of known blocks */
+int update=0;	/* rewrite only tracks that differ from the Merkle leaves */
+rhext changed;	/* sectors rewritten by update */
+rhext kept;	/* sectors of tracks update left alone: some were unreadable */
+int retries=10;	/* per unreadable sector, r key changes it */
+int stop=0;	/* q key: stop after the current track */
+char *statfn=NULL;	/* JSON status, rewritten every cylinder */
+unsigned int curtrack=0, curhead=0;
+unsigned long ndone=0;	/* tracks done, including those of earlier runs */
+unsigned long ncopied=0, nbad=0, nretry=0;	/* this run */
+time_t started;
 
 int c_break(void)
 {
+	int i;
 	printf("Aborting on Ctrl-Break\n");
-	close(dfh);
+	for(i=0;i<ndst;i++)
+		dst_close(&dst[i],0);
+	if(mkf!=NULL)
+		fclose(mkf);	/* leaf hashes are still good for -r */
+	if(crcf!=NULL)
+		fclose(crcf);
+	if(entf!=NULL)
+		fclose(entf);
+	if(sigf!=NULL)
+		fclose(sigf);
+	if(trif!=NULL)
+		fclose(trif);
+	kb_close(&kb);
+	if(knwf!=NULL)
+		fclose(knwf);
 	fprintf(lf,"Aborted by Ctrl-Break!\n");
 	fclose(lf);
 	return 0;
@@ -126,67 +190,355 @@ int hddinfo()
 	return rv;
 }
 
+static void json_str(FILE *f, const char *p)
+{
+	fputc('"',f);
+	for(;*p;p++)
+	{
+		if(*p=='"' || *p=='\\')	/* DOS paths */
+			fputc('\\',f);
+		fputc(*p,f);
+	}
+	fputc('"',f);
+}
+
+/* read rate of this run, KB (1000 bytes) a second */
+unsigned long read_rate(void)
+{
+	unsigned long secs=(unsigned long)(time(NULL)-started);
+	return secs?ncopied*(trackbytes/8)/125/secs:0;
+}
+
+/* write the status file (-j), for whoever watches the copy from elsewhere */
+void status(const char *state)
+{
+	FILE *f;
+	int i;
+	if(statfn==NULL || (f=fopen(statfn,"wt"))==NULL)
+		return;
+	fprintf(f,"{\"state\":\"%s\",\"cylinder\":%u,\"head\":%u,\"geometry\":[%u,%u,%u],\n",
+		state,curtrack,curhead,tracks,heads,sectors);
+	fprintf(f," \"tracks_done\":%lu,\"tracks\":%lu,\"bad_sectors\":%lu,\"retries\":%lu,\n",
+		ndone,(unsigned long)tracks*heads,nbad,nretry);
+	fprintf(f," \"retry_limit\":%d,\"seconds\":%lu,\"read_kbs\":%lu,\"dest\":[",
+		retries,(unsigned long)(time(NULL)-started),read_rate());
+	for(i=0;i<ndst;i++)
+	{
+		fprintf(f,"%s\n  {\"file\":",i?",":"");
+		json_str(f,dst[i].fn);
+		fprintf(f,",\"written\":%lu,\"limit_kbs\":%lu}",dst[i].out,dst[i].rate);
+	}
+	fprintf(f,"]}\n");
+	fclose(f);
+}
+
+/* keys pressed while copying, looked at between tracks */
+void keys(void)
+{
+	int c=getch();
+	int i;
+	switch(c)
+	{
+	case 'p':
+	case 'P':
+	case ' ':
+		printf("Paused at CH %u,%u; q stops, any other key continues\n",curtrack,curhead);
+		fprintf(lf,"Paused at CH %u,%u\n",curtrack,curhead);
+		status("paused");
+		c=getch();
+		if(c!='q' && c!='Q')
+		{
+			fprintf(lf,"Continued\n");
+			return;
+		}
+		/* no break */
+	case 'q':
+	case 'Q':
+		printf("Stopping; resume with -r=rawhdd.log\n");
+		stop=1;
+		return;
+	case 'r':
+	case 'R':	/* 10, 3, no retries; e.g. a first pass that skips bad areas */
+		retries=retries>3?3:retries>0?0:10;
+		printf("Retries per bad sector: %d\n",retries);
+		fprintf(lf,"Retries per bad sector: %d\n",retries);
+		return;
+	case 's':
+	case 'S':
+		printf("CH %u,%u: %lu of %lu tracks, %lu bad sectors, %lu retries, %lu KB/s\n",
+			curtrack,curhead,ndone,(unsigned long)tracks*heads,nbad,nretry,read_rate());
+		status("copying");
+		return;
+	}
+	for(i=0;i<ndst;i++)
+	{
+		if(dst[i].rate==0)
+			continue;
+		if(c=='+')
+			dst[i].rate+=dst[i].rate/4+1;
+		else if(c=='-' && dst[i].rate>1)
+			dst[i].rate-=(dst[i].rate+3)/4;
+		else
+			continue;
+		printf("%s: write limit %lu KB/s\n",dst[i].fn,dst[i].rate);
+		fprintf(lf,"%s: write limit %lu KB/s\n",dst[i].fn,dst[i].rate);
+	}
+}
+
+/* .SIG of a resumed copy: hits on tracks that are copied again would
+ * come twice, so only those on tracks already done are kept. Returns the
+ * file open for adding, NULL if there is none to keep */
+FILE *sig_keep(const char *name)
+{
+	char line[128], tmp[NAMELEN];
+	FILE *in, *out;
+	unsigned long lba;
+	int res=0;
+	if(sidecar(tmp,sizeof(tmp),name,"$SG")!=0 || (in=fopen(name,"rt"))==NULL)
+		return NULL;
+	if(fgets(line,sizeof(line),in)==NULL || strncmp(line,"RAWHDD SIGNATURES",17)!=0 ||
+		(out=fopen(tmp,"wt"))==NULL)
+	{
+		fclose(in);
+		return NULL;
+	}
+	fputs("RAWHDD SIGNATURES\n",out);
+	while(fgets(line,sizeof(line),in)!=NULL)
+		if(sscanf(line,"%lu",&lba)==1 && map_done(&map,lba/sectors))
+			res|=fputs(line,out)<0;
+	fclose(in);
+	if(fclose(out)!=0 || res!=0 || remove(name)!=0 || rename(tmp,name)!=0)
+		return NULL;
+	return fopen(name,"at");
+}
+
+/* write a track to destination and update its hash.
+ * bad[i] is set for unreadable sectors, bad==NULL if all were read */
+int put_track(unsigned int head,unsigned int track,void *buf,unsigned char *bad)
+{
+	unsigned long trk=(unsigned long)track*heads+head;
+	unsigned char c[4];
+	int i;
+	/* first, so that hashes and sidecars describe what is stored */
+	if(kb.f!=NULL && kb_track(&kb,trk*sectors,buf,sectors,blank)!=0)
+		return -1;
+	if(sigf!=NULL)	/* before update skips the track: -u rebuilds the .SIG */
+	{
+		if((i=sig_scan(sigf,trk*sectors,buf,sectors))<0)
+			return -1;
+		sighits+=i;
+	}
+	if(update)	/* only write tracks whose hash changed */
+	{
+		if(bad!=NULL)	/* would replace good data and its leaf with errors */
+		{
+			for(i=0;i<sectors;i++)
+				ext_add(&kept,trk*sectors+i);
+			return 0;
+		}
+		if((i=mk_changed(mkf,trk,buf,trackbytes))<=0)
+			return i;
+		for(i=0;i<sectors;i++)
+			ext_add(&changed,trk*sectors+i);
+	}
+	else if(mkf!=NULL && mk_leaf(mkf,trk,buf,trackbytes)!=0)
+		return -1;
+	for(i=0;i<ndst;i++)
+		if(dst_track(&dst[i],trk,buf,bad)!=0)
+			return -1;
+	if(crcf!=NULL)
+	{
+		put32le(c,crc32c(0,buf,trackbytes));
+		if(fseek(crcf,CRC_HDRLEN+trk*4,SEEK_SET)!=0 || fwrite(c,4,1,crcf)!=1)
+			return -1;
+	}
+	if(entf!=NULL)
+	{
+		i=entropy(buf,trackbytes);
+		if(fseek(entf,ENT_HDRLEN+trk,SEEK_SET)!=0 || fputc(1+(i<254?i:254),entf)==EOF)
+			return -1;
+	}
+	if(trif!=NULL)
+	{
+		tri_block(buf,trackbytes,bloom);
+		if(fseek(trif,TRI_HDRLEN+trk*TRI_BYTES(trackbytes),SEEK_SET)!=0 ||
+			fwrite(bloom,TRI_BYTES(trackbytes),1,trif)!=1)
+			return -1;
+	}
+	return 0;
+}
+
 /* try to copy whole track (it's faster) */
-int copy_track(unsigned int head,unsigned int track,void *buf,int f)
+int copy_track(unsigned int head,unsigned int track,void *buf)
 {
 	if(biosdisk(2,drive,head,track,1,sectors,buf)!=0)
 		return 1;
-	if(write(f,buf,trackbytes)!=trackbytes)
+	if(put_track(head,track,buf,NULL)!=0)
 		return -1;
 	printf("CH %d,%d OK\n",track,head);
 	return 0;
 }
 
-/* try to copy track sector-by-sector */
-int copy_sects(unsigned int head,unsigned int track,void *buf,int f, FILE *lf)
+/* read one sector, retrying upon error. returns 0 if the read succeeded */
+int read_sect(unsigned int head,unsigned int track,int i,char *sbuf)
 {
-	int i;
 	int retr;
 	int res;
-	for(i=1;i<=sectors;i++)
+	if((res=biosdisk(2,drive,head,track,i,1,sbuf))==0)
+		return 0;
+	/* upon error retry, up to 10 times unless changed with the r key */
+	retr=retries;
+	while(retr>0 && res!=0)
+	{
+		printf("*");	/* one * means one failed read */
+		nretry++;
+		/* reset controller before retrying */
+		biosdisk(0,drive,0,0,0,1,NULL);
+		res=biosdisk(2,drive,head,track,i,1,sbuf);
+		retr--;
+	}
+	return res;
+}
+
+/* try to copy track sector-by-sector */
+int copy_sects(unsigned int head,unsigned int track,void *buf,FILE *lf)
+{
+	int i;
+	char *sbuf;
+	unsigned char bad[64];
+	for(i=1,sbuf=buf;i<=sectors;i++,sbuf+=512)
 	{
-		if(biosdisk(2,drive,head,track,i,1,buf)!=0)
+		/* if read didn't succeed after multiple retries,
+		 * print and log error */
+		bad[i-1]=(read_sect(head,track,i,sbuf)!=0);
+		if(bad[i-1])
 		{
-			/* upon error retry up to 10 times */
-			res=1;retr=10;
-			while(retr>0 && res!=0)
-			{
-				printf("*");	/* one * means one failed read */
-				/* reset controller before retrying */
-				biosdisk(0,drive,0,0,0,1,NULL);
-				res=biosdisk(2,drive,head,track,i,1,buf);
-				retr--;
-			}
-			/* if read didn't succeed after multiple retries,
-			 * print and log error */
-			if(res!=0)
-			{
-				printf("Error reading CHS %d,%d,%d\n",track,head,i);
-				fprintf(lf,"ERR: %d,%d,%d\n",track,head,i);
-			}
-			else /* success after some retries */
-			{
-				fprintf(lf,"OK: %d,%d,%d\n",track,head,i);
-				printf(".");
-			}
+			nbad++;
+			printf("Error reading CHS %d,%d,%d\n",track,head,i);
+			fprintf(lf,"ERR: %d,%d,%d\n",track,head,i);
 		}
-		else	/* sector was read without retries */
+		else
 		{
 			fprintf(lf,"OK: %d,%d,%d\n",track,head,i);
 			printf(".");
 		}
-		/* write no matter what (keep output in sync with disk position) */
-		if(write(f,buf,512)!=512)
-			return -1;	/* a write error probably means disk full, log will fail as well */
 	}
+	/* write no matter what (keep output in sync with disk position) */
+	if(put_track(head,track,buf,bad)!=0)
+		return -1;	/* a write error probably means disk full, log will fail as well */
+	return 0;
+}
+
+/* compare track with the image; report differing and unreadable
+ * sectors as runs of LBAs. returns -1 if the image can't be read */
+int verify_track(unsigned int head,unsigned int track,char *buf,char *ibuf,int f,
+	rhext *diff,rhext *unr)
+{
+	unsigned long lba=((unsigned long)track*heads+head)*sectors;
+	int got;
+	int i;
+	int rd;
+
+	got=read(f,ibuf,trackbytes);
+	if(got<0)
+		return -1;
+	rd=(biosdisk(2,drive,head,track,1,sectors,buf)==0);
+	if(rd && got==trackbytes && memcmp(buf,ibuf,trackbytes)==0)
+	{
+		printf("CH %d,%d OK\n",track,head);
+		return 0;
+	}
+	printf("CH %d,%d ",track,head);
+	for(i=0;i<sectors;i++,lba++)
+	{
+		if(!rd && read_sect(head,track,i+1,buf+i*512)!=0)
+			ext_add(unr,lba);
+		else if((i+1)*512>got || memcmp(buf+i*512,ibuf+i*512,512)!=0)
+			ext_add(diff,lba);
+	}
+	printf("\n");
+	return 0;
+}
+
+/* re-read whole drive and compare with image in dfh */
+int verify_image(char *buf)
+{
+	char *ibuf;
+	unsigned int track;
+	unsigned int head;
+	rhext diff, unr;
+
+	ibuf=malloc(trackbytes);
+	if(ibuf==NULL)
+	{
+		printf("malloc failed\n");
+		return -1;
+	}
+	ext_init(&diff,"DIFF",lf);
+	ext_init(&unr,"UNREADABLE",lf);
+	for(track=0;track<tracks;track++) for(head=0;head<heads;head++)
+	{
+		if(verify_track(head,track,buf,ibuf,dfh,&diff,&unr)!=0)
+		{
+			printf("Error reading image\n");
+			free(ibuf);
+			return -1;
+		}
+	}
+	ext_flush(&diff);
+	ext_flush(&unr);
+	printf("Verify: %lu sectors differ (%lu runs), %lu unreadable (%lu runs)\n",
+		diff.total,diff.runs,unr.total,unr.runs);
+	fprintf(lf,"Verify: %lu sectors differ (%lu runs), %lu unreadable (%lu runs)\n",
+		diff.total,diff.runs,unr.total,unr.runs);
+	free(ibuf);
 	return 0;
 }
 
 void print_usage()
 {
-	printf("Usage: rawhdd [-d=drive] [-c=cylinders] [-h=heads] [-s=sectors] <dst_file>\n");
+	printf("Usage: rawhdd [-d=drive] [-c=cylinders] [-h=heads] [-s=sectors] [-r=logfile] [-m=1] [-k=1] [-v=1] [-u=1]\n");
+	printf("              [-n=1] [-i=1|sigfile] [-t=1] [-x=db[,lba]] [-y=1] [-j=file]\n");
+	printf("              [-o=raw|frame|stripe|seg|ewf|qcow2|aes] [-g=MB] [-z=1|a]\n");
+	printf("              [-e=keyfile] [-b=KB/s] <dst_file> [[-o=..] dst_file]...\n");
 	printf("Will copy raw HDD \"image\" to dst_file.\nIf dst_file exists, it will be overwritten.\n");
 	printf("The file rawhdd.log will be created (or appended to) and will log operations.\n");
+	printf("-r resumes an interrupted copy: tracks logged as OK in logfile (usually\n");
+	printf("   rawhdd.log) are skipped, everything else is read into existing dst_file.\n");
+	printf("-m=1 keeps a SHA-256 Merkle tree of the image: one leaf hash per track in\n");
+	printf("   dst_file.MKL, followed by the root when all tracks were copied.\n");
+	printf("   rawmkl checks any range of tracks against the root.\n");
+	printf("-k=1 writes the CRC-32C of each track to dst_file.CRC (check with rawcrc);\n");
+	printf("   the first dst_file must be -o=raw or -o=seg.\n");
+	printf("-n=1 writes the entropy of each track to dst_file.ENT (list with rawent).\n");
+	printf("-i=1 lists file signatures (JPEG, PDF, ZIP, ...) found at sector starts\n");
+	printf("   by LBA in dst_file.SIG; -i=sigfile uses the signatures in sigfile.\n");
+	printf("-t=1 indexes the text of each track in dst_file.TRI (search with rawgrep).\n");
+	printf("-x=db[,lba] lists blocks found in a known block database (see rawkbdb) in\n");
+	printf("   dst_file.KNW; blocks start at lba (default 0) modulo the block size.\n");
+	printf("   -y=1 also leaves them out of the copy (zeros, or holes where possible).\n");
+	printf("-j=file keeps a JSON status (position, rates, errors) in file, e.g. on a share.\n");
+	printf("-v=1 does not copy: drive is read again and compared with existing dst_file,\n");
+	printf("   differing and unreadable sectors are logged as LBA ranges.\n");
+	printf("-u=1 updates an image made with -m=1: drive is read again and only tracks\n");
+	printf("   whose hash differs from dst_file.MKL are written. Changes are logged;\n");
+	printf("   tracks with unreadable sectors are left as they were.\n");
+	printf("-o=frame writes a framed stream (for a pipe, serial port or share) instead of\n");
+	printf("   an image; rawrecv rebuilds image and log from it. -z=1 compresses frames,\n");
+	printf("   -z=a only while that is faster than sending them as they are.\n");
+	printf("-o=stripe spreads tracks over several files (e.g. on different drives);\n");
+	printf("   dst_file is given as manifest=file1,file2,... (rawcat reads it back).\n");
+	printf("-o=seg splits the image into files of -g=MB (default 2047): dst_file.000,\n");
+	printf("   .001, ... with dst_file as their index, holding the CRC-32C of each.\n");
+	printf("-o=ewf writes an EnCase image, dst_file.E01, .E02, ... of up to -g=MB each,\n");
+	printf("   with unreadable sectors in its error list; can't be used with -r or -u.\n");
+	printf("-o=qcow2 writes a sparse qcow2 image (all-zero clusters are left out).\n");
+	printf("-o=aes encrypts each track with AES-256-GCM, key derived from -e=keyfile.\n");
+	printf("-b=KB/s limits how fast a destination is written (KB are 1000 bytes); the\n");
+	printf("   + and - keys raise or lower all limits by a quarter while copying.\n");
+	printf("Up to %d destinations get the same data from a single read; -o, -z and -b\n",MAXDST);
+	printf("apply to the destinations after them. The first one is the image named in\n");
+	printf("the log.\n");
 	printf("Drive numbers are 0 based, i.e. first hard drive is numbered 0.\n");
 }
 
@@ -214,6 +566,71 @@ int setopt(char *arg, myopts *opt)
 			opt->drive=0x80+atoi(arg+3);
 			opt->ds=1;
 			return 0;
+		case 'r':
+			opt->resume=arg+3;
+			return 0;
+		case 'm':
+			opt->merkle=atoi(arg+3);
+			return 0;
+		case 'k':
+			opt->crc=atoi(arg+3);
+			return 0;
+		case 'n':
+			opt->ent=atoi(arg+3);
+			return 0;
+		case 'i':
+			opt->sigs=arg+3;
+			return 0;
+		case 't':
+			opt->tri=atoi(arg+3);
+			return 0;
+		case 'x':
+			opt->known=arg+3;
+			return 0;
+		case 'y':
+			opt->blank=atoi(arg+3);
+			return 0;
+		case 'j':
+			opt->status=arg+3;
+			return 0;
+		case 'v':
+			opt->verify=atoi(arg+3);
+			return 0;
+		case 'u':
+			opt->update=atoi(arg+3);
+			return 0;
+		case 'o':
+			if(strcmp(arg+3,"raw")==0)
+				opt->format=FMT_RAW;
+			else if(strcmp(arg+3,"frame")==0)
+				opt->format=FMT_FRAME;
+			else if(strcmp(arg+3,"stripe")==0)
+				opt->format=FMT_STRIPE;
+			else if(strcmp(arg+3,"seg")==0)
+				opt->format=FMT_SEG;
+			else if(strcmp(arg+3,"ewf")==0)
+				opt->format=FMT_EWF;
+			else if(strcmp(arg+3,"qcow2")==0)
+				opt->format=FMT_QCOW;
+			else if(strcmp(arg+3,"aes")==0)
+				opt->format=FMT_AES;
+			else
+				return -1;
+			return 0;
+		case 'z':
+			opt->lz=arg[3]=='a'?LZ_AUTO:atoi(arg+3);
+			return 0;
+		case 'e':
+			opt->keyfile=arg+3;
+			return 0;
+		case 'b':
+			opt->rate=(unsigned long)atol(arg+3);
+			return 0;
+		case 'g':
+			opt->segmb=atoi(arg+3);
+			if(opt->segmb<1 || opt->segmb>2047)	/* offsets are signed longs */
+				return -1;
+			return 0;
 		default:
 			return -1;
 	}
@@ -230,9 +647,21 @@ int main(int argc,char *argv[])
 	unsigned int track;
 	unsigned int head;
 	int rhi;
+	unsigned long trk;
+	char mkname[NAMELEN];
+	char crcname[NAMELEN];
+	char entname[NAMELEN];
+	char signame[NAMELEN];
+	char triname[NAMELEN];
+	char knwname[NAMELEN];
+	char *p;
+	unsigned char hdr[CRC_HDRLEN];
+	unsigned char root[MK_HASHLEN];
+	unsigned char key[AES_KEYLEN];
 
 	/* "quick&dirty" options */
 	memset(&opts,0,sizeof(opts));
+	opts.segmb=2047;	/* largest file FAT16 takes */
 	drive=0x80;	/* default */
 	for(i=1;i<argc;i++)
 	{
@@ -242,26 +671,76 @@ int main(int argc,char *argv[])
 			print_usage();
 			exit(1);
 		}
-		if(res==1)
+		if(res==1)	/* destination, in the format selected so far */
 		{
-			if(fn==NULL)
-				fn=argv[i];
-			else /* more than one filename? */
+			if(ndst==MAXDST)
 			{
 				print_usage();
 				exit(1);
 			}
+			if(dst_init(&dst[ndst],argv[i],opts.format,opts.lz)!=0)
+			{
+				print_usage();
+				exit(1);
+			}
+			dst[ndst].segsize=(unsigned long)opts.segmb<<20;
+			dst[ndst].rate=opts.rate;
+			ndst++;
 		}
 	}
 	/* sanity check */
-	if(fn==NULL)
+	if(ndst==0)
 	{
 		print_usage();
 		exit(1);
 	}
+	fn=dst[0].fn;
 
 	if(opts.ds)
 		drive=opts.drive;
+	if(opts.verify && (opts.resume!=NULL || opts.merkle || opts.crc || opts.ent || opts.sigs!=NULL || opts.tri || opts.known!=NULL || opts.update))
+	{
+		printf("-v can't be combined with -r, -m, -k, -n, -i, -t, -x or -u\n");
+		exit(1);
+	}
+	if(opts.verify && (ndst>1 || dst[0].format!=FMT_RAW))
+	{
+		printf("-v needs one raw image\n");
+		exit(1);
+	}
+	/* rawcrc reads the file itself, so the blocks must be the image bytes */
+	if(opts.crc && dst[0].format!=FMT_RAW && dst[0].format!=FMT_SEG)
+	{
+		printf("-k needs a raw or seg first dst_file (rawcrc checks its bytes)\n");
+		exit(1);
+	}
+	if(opts.update && opts.resume!=NULL)
+	{
+		printf("-u can't be combined with -r\n");
+		exit(1);
+	}
+	for(i=0;i<ndst;i++)
+		if(dst[i].format==FMT_EWF && (opts.update || opts.resume!=NULL))
+		{
+			printf("EWF images are written in one go, -r and -u can't add to them\n");
+			exit(1);
+		}
+	if(opts.keyfile!=NULL)
+	{
+		if(aes_keyfile(opts.keyfile,key)!=0)
+		{
+			printf("Unable to read key file %s (at least 16 bytes)\n",opts.keyfile);
+			exit(1);
+		}
+		dst_key(key);
+		memset(key,0,sizeof(key));
+	}
+	for(i=0;i<ndst;i++)
+		if(dst[i].format==FMT_AES && opts.keyfile==NULL)
+		{
+			printf("-o=aes needs a key file, -e=keyfile\n");
+			exit(1);
+		}
 
 
 	printf("HDD Imaging program. Checking HDD...\n");
@@ -284,6 +763,11 @@ int main(int argc,char *argv[])
 		printf("CHS: %u,%u,%u\n",tracks,heads,sectors);
 		exit(1);
 	}
+	if(sectors>63)	/* INT 13h can't address more; copy_sects has a flag for each */
+	{
+		printf("At most 63 sectors per track (CHS: %u,%u,%u)\n",tracks,heads,sectors);
+		exit(1);
+	}
 	trackbytes=512*sectors;
 	buf=malloc(trackbytes); /* one track */
 	if(buf==NULL)
@@ -292,11 +776,34 @@ int main(int argc,char *argv[])
 		exit(1);
 	}
 
+	/* rebuild map of tracks already copied */
+	if(opts.resume!=NULL)
+	{
+		map.tracks=0;
+		if(map_init(&map,tracks,heads,sectors)!=0)
+		{
+			printf("Not enough memory for track map\n");
+			free(buf);
+			exit(1);
+		}
+		if((res=map_import(&map,opts.resume,fn))<0)
+		{
+			printf("Unable to read %s\n",opts.resume);
+			free(buf);
+			exit(1);
+		}
+		printf("Resuming: %d session(s) in %s, %lu of %lu tracks already copied\n",
+			res,opts.resume,map_count(&map),map_ntracks(&map));
+	}
+
 	/* print info and offer chance to abort */
 	if(opts.ts || opts.hs || opts.ss)
 		printf("Using command line drive geometry\n");
 	printf("Will read: %u cylinders, %u heads, %u sectors\n",tracks,heads,sectors);
-	printf("Will write to: %s\n",fn);
+	printf("Will %s: %s",opts.verify?"compare with":"write to",fn);
+	for(i=1;i<ndst;i++)
+		printf(", %s",dst[i].fn);
+	printf("\n");
 	if(rhi)
 		printf("Possible geometry mismatch (see warning above)\nProceed at your own risk!\n");
 	printf("Press ENTER to continue or any other key to abort\n");
@@ -306,34 +813,226 @@ int main(int argc,char *argv[])
 		exit(2);
 	}
 
-	dfh=open(fn,O_CREAT|O_BINARY|O_TRUNC|O_WRONLY,S_IREAD|S_IWRITE);
-	if(dfh<1)
+	if(opts.verify)
+	{
+		dfh=open(fn,O_BINARY|O_RDONLY);
+		if(dfh<1)
+		{
+			perror("Error opening image file.\n");
+			goto fail;
+		}
+	}
+	else
+	{
+		dst_geometry(tracks,heads,sectors);
+		for(i=0;i<ndst;i++)
+			if(dst_open(&dst[i],opts.resume!=NULL || opts.update)!=0)
+			{
+				printf("%s: ",dst[i].fn);
+				perror("Error creating destination file.\n");
+				goto fail;
+			}
+	}
+
+	if(opts.update)	/* leaf hashes of the previous image tell what changed */
 	{
-		perror("Error creating destination file.\n");
-		goto fail;
+		if(sidecar(mkname,sizeof(mkname),fn,"MKL")!=0)
+			goto fail;
+		if((mkf=fopen(mkname,"r+b"))==NULL)
+		{
+			perror("Error opening hash file.\n");
+			goto fail;
+		}
+		update=1;
+	}
+	else if(opts.merkle)	/* leaf hashes of skipped tracks are kept when resuming */
+	{
+		if(sidecar(mkname,sizeof(mkname),fn,"MKL")!=0)
+			goto fail;
+		if(opts.resume==NULL || (mkf=fopen(mkname,"r+b"))==NULL)
+			mkf=fopen(mkname,"w+b");
+		if(mkf==NULL)
+		{
+			perror("Error creating hash file.\n");
+			goto fail;
+		}
+	}
+
+	if(opts.crc)	/* CRCs of skipped tracks are kept too, if block size matches */
+	{
+		if(sidecar(crcname,sizeof(crcname),fn,"CRC")!=0)
+			goto fail;
+		if((opts.resume!=NULL || update) && (crcf=fopen(crcname,"r+b"))!=NULL)
+		{
+			if(fread(hdr,CRC_HDRLEN,1,crcf)!=1 || get32le(hdr+4)!=trackbytes)
+			{
+				fclose(crcf);
+				crcf=NULL;
+			}
+		}
+		if(crcf==NULL)
+		{
+			memcpy(hdr,"RHC1",4);
+			put32le(hdr+4,trackbytes);
+			if((crcf=fopen(crcname,"w+b"))==NULL || fwrite(hdr,CRC_HDRLEN,1,crcf)!=1)
+			{
+				perror("Error creating CRC file.\n");
+				goto fail;
+			}
+		}
+	}
+
+	if(opts.ent)	/* same layout as the CRC file, one byte per track */
+	{
+		if(sidecar(entname,sizeof(entname),fn,"ENT")!=0)
+			goto fail;
+		if((opts.resume!=NULL || update) && (entf=fopen(entname,"r+b"))!=NULL)
+		{
+			if(fread(hdr,ENT_HDRLEN,1,entf)!=1 || get32le(hdr+4)!=trackbytes)
+			{
+				fclose(entf);
+				entf=NULL;
+			}
+		}
+		if(entf==NULL)
+		{
+			memcpy(hdr,"RHE1",4);
+			put32le(hdr+4,trackbytes);
+			if((entf=fopen(entname,"w+b"))==NULL || fwrite(hdr,ENT_HDRLEN,1,entf)!=1)
+			{
+				perror("Error creating entropy file.\n");
+				goto fail;
+			}
+		}
+	}
+
+	if(opts.sigs!=NULL && strcmp(opts.sigs,"0")!=0)	/* -u scans every track again */
+	{
+		if(sig_load(strcmp(opts.sigs,"1")==0?NULL:opts.sigs)<=0)
+		{
+			printf("Unable to read signatures from %s\n",opts.sigs);
+			goto fail;
+		}
+		if(sidecar(signame,sizeof(signame),fn,"SIG")!=0)
+			goto fail;
+		if(opts.resume!=NULL)
+			sigf=sig_keep(signame);
+		if(sigf==NULL && ((sigf=fopen(signame,"wt"))==NULL || fprintf(sigf,"RAWHDD SIGNATURES\n")<0))
+		{
+			perror("Error creating signature file.\n");
+			goto fail;
+		}
+	}
+
+	if(opts.tri)	/* same layout as the CRC file, a filter per track */
+	{
+		if((bloom=malloc(TRI_BYTES(trackbytes)))==NULL)
+		{
+			printf("malloc failed\n");
+			goto fail;
+		}
+		if(sidecar(triname,sizeof(triname),fn,"TRI")!=0)
+			goto fail;
+		if((opts.resume!=NULL || update) && (trif=fopen(triname,"r+b"))!=NULL)
+		{
+			if(fread(hdr,TRI_HDRLEN,1,trif)!=1 || get32le(hdr+4)!=trackbytes)
+			{
+				fclose(trif);
+				trif=NULL;
+			}
+		}
+		if(trif==NULL)
+		{
+			memcpy(hdr,"RHT1",4);
+			put32le(hdr+4,trackbytes);
+			if((trif=fopen(triname,"w+b"))==NULL || fwrite(hdr,TRI_HDRLEN,1,trif)!=1)
+			{
+				perror("Error creating trigram file.\n");
+				goto fail;
+			}
+		}
+	}
+
+	if(opts.known!=NULL)	/* ranges of resumed copies are added */
+	{
+		if((p=strchr(opts.known,','))!=NULL)
+			*p++=0;
+		if(kb_open(&kb,opts.known,p!=NULL?atol(p):0)!=0)
+		{
+			printf("Unable to load known block database %s\n",opts.known);
+			goto fail;
+		}
+		if(sidecar(knwname,sizeof(knwname),fn,"KNW")!=0)
+			goto fail;
+		if(opts.resume!=NULL || update)
+			knwf=fopen(knwname,"at");
+		if(knwf==NULL && ((knwf=fopen(knwname,"wt"))==NULL || fprintf(knwf,"RAWHDD KNOWN BLOCKS\n")<0))
+		{
+			perror("Error creating known block file.\n");
+			goto fail;
+		}
+		kb.out=knwf;
+		blank=opts.blank;
 	}
 
 	/* log */
 	lf=fopen("rawhdd.log","at");
 	t = time(NULL);
 	tms = localtime(&t);
-	fprintf(lf,"\n%s copy started at %s\n",fn,asctime(tms));
+	/* map_import() only looks at "copy" sessions */
+	fprintf(lf,"\n%s %s started at %s\n",fn,opts.verify?"verify":"copy",asctime(tms));
 	fprintf(lf,"Drive %u CHS: %u,%u,%u\n",drive-0x80,tracks,heads,sectors);
+	if(opts.resume!=NULL)	/* map_import() relies on this line */
+		fprintf(lf,"Resuming from %s: %lu of %lu tracks done\n",
+			opts.resume,map_count(&map),map_ntracks(&map));
+	if(update)	/* same for updates, image is not truncated */
+		fprintf(lf,"Updating from %s\n",mkname);
+	for(i=1;i<ndst;i++)	/* a single read goes to all of them */
+		fprintf(lf,"Also writing to %s\n",dst[i].fn);
+	ext_init(&changed,"CHANGED",lf);
+	ext_init(&kept,"KEPT",lf);
 
 	/* catch Ctrl+break (to write it in log before exiting) */
 	ctrlbrk(c_break);
+	started=time(NULL);
+	statfn=opts.status;
+
+	if(opts.verify)
+	{
+		res=verify_image(buf);
+		close(dfh);
+		dfh=0;
+		if(res!=0)
+			goto fail;
+		goto done;
+	}
 
 	/* read each head from each track */
-	for(track=0;track<tracks;track++) for(head=0;head<heads;head++)
+	if(opts.resume!=NULL)
+		ndone=map_count(&map);
+	for(track=0;track<tracks && !stop;track++) for(head=0;head<heads;head++)
 	{
-		res=copy_track(head,track,buf,dfh);
+		if(opts.resume!=NULL)
+		{
+			trk=MAP_TRK(&map,track,head);
+			if(map_done(&map,trk))
+				continue;
+		}
+		curtrack=track;
+		curhead=head;
+		if(kbhit())
+			keys();
+		if(stop)
+			break;
+		if(head==0)
+			status("copying");
+		res=copy_track(head,track,buf);
 		if(res==0)		/* log */
 			fprintf(lf,"OK: %d,%d,*\n",track,head);
 		if(res>0)     /* read track failed */
 		{
-			if((res=copy_sects(head,track,buf,dfh,lf))<0)  /* try sector by sector */
+			if((res=copy_sects(head,track,buf,lf))<0)  /* try sector by sector */
 			{                          /* negative result means write failed */
-				close(dfh);
 				printf("write failed\n");
 				goto fail;
 			}
@@ -343,17 +1042,95 @@ int main(int argc,char *argv[])
 			printf("write failed\n");
 			goto fail;
 		}
+		ndone++;
+		ncopied++;
+	}
+	for(i=0;i<ndst;i++)	/* a stopped copy is left as Ctrl-Break leaves it */
+		if(dst_close(&dst[i],!stop)!=0)
+		{
+			printf("write failed\n");
+			goto fail;
+		}
+	status(stop?"stopped":"done");
+	if(stop)
+		fprintf(lf,"Stopped by user at CH %u,%u\n",curtrack,curhead);
+	else
+		printf("Done.\n");
+	if(update)
+	{
+		ext_flush(&changed);
+		ext_flush(&kept);
+		printf("Update: %lu sectors rewritten (%lu runs)\n",changed.total,changed.runs);
+		fprintf(lf,"Update: %lu sectors rewritten (%lu runs)\n",changed.total,changed.runs);
+		if(kept.total>0)
+		{
+			printf("Update: %lu sectors on tracks with read errors left as they were\n",kept.total);
+			fprintf(lf,"Update: %lu sectors on tracks with read errors left as they were\n",kept.total);
+		}
+	}
+	if(mkf!=NULL)
+	{
+		res=mk_root(mkf,(unsigned long)tracks*heads,root);
+		if(res==0)
+		{
+			fprintf(lf,"Merkle root: ");
+			printf("Merkle root: ");
+			for(i=0;i<MK_HASHLEN;i++)
+			{
+				fprintf(lf,"%02x",root[i]);
+				printf("%02x",root[i]);
+			}
+			fprintf(lf,"\n");
+			printf("\n");
+		}
+		else if(res>0)
+			printf("Merkle root not computed: some tracks were never hashed\n");
+		else
+			printf("Error writing %s\n",mkname);
+		fclose(mkf);
+	}
+	if(crcf!=NULL)
+		fclose(crcf);
+	if(entf!=NULL)
+		fclose(entf);
+	if(sigf!=NULL)
+	{
+		printf("%lu file signatures found, listed in %s\n",sighits,signame);
+		fclose(sigf);
+	}
+	if(trif!=NULL)
+		fclose(trif);
+	free(bloom);
+	if(kb.f!=NULL)
+	{
+		kb_close(&kb);
+		printf("%lu sectors in known blocks%s, listed in %s\n",kb.total,
+			opts.blank?" (not stored)":"",knwname);
+		fprintf(lf,"%lu sectors in known blocks%s\n",kb.total,opts.blank?" (not stored)":"");
 	}
-	printf("Done.\n");
-	close(dfh);
+	if(knwf!=NULL)
+		fclose(knwf);
+done:
 	t = time(NULL);
 	tms = localtime(&t);
-	fprintf(lf,"%s copy finished at %s\n",fn,asctime(tms));
+	fprintf(lf,"%s %s finished at %s\n",fn,opts.verify?"verify":"copy",asctime(tms));
 	fclose(lf);
 	free(buf);
+	map_free(&map);
 	return(0);
 fail:
 	free(buf);
+	for(i=0;i<ndst;i++)
+		dst_close(&dst[i],0);
+	map_free(&map);
+	if(mkf!=NULL) fclose(mkf);
+	if(crcf!=NULL) fclose(crcf);
+	if(entf!=NULL) fclose(entf);
+	if(sigf!=NULL) fclose(sigf);
+	if(trif!=NULL) fclose(trif);
+	free(bloom);
+	kb_close(&kb);
+	if(knwf!=NULL) fclose(knwf);
 	if(dfh) close(dfh);
 	if(lf!=NULL) fclose(lf);
 	return(1);
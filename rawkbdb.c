@@ -0,0 +1,217 @@
+/* rawkbdb - make the known block database used by rawhdd -x: the MD5 of
+ * every block of the given files (e.g. a clean install of the operating
+ * system), or MD5s from a hash list. All-zero blocks are left out.
+ * Holds every hash in memory; build it on the storage host.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "knownblk.h"
+#include "md5.h"
+#include "crc32c.h"
+
+unsigned char *hash=NULL;	/* 16 bytes each */
+unsigned long nhash=0, maxhash=0;
+
+void print_usage()
+{
+	printf("Usage: rawkbdb [-b=block_bytes] [-f=namelist] [-l=hashlist] <db> [file]...\n");
+	printf("Writes db with the MD5 of each block of each file (the last one padded\n");
+	printf("with zeros), for rawhdd -x=db. Block size (default 4096) should be the\n");
+	printf("cluster size of the file systems to be imaged. -f reads file names from\n");
+	printf("namelist, one per line; -l adds MD5s from hashlist, 32 hex digits at the\n");
+	printf("start of each line, which must be of blocks of the same size.\n");
+}
+
+int add(const unsigned char *h)
+{
+	unsigned char *p;
+	if(nhash==maxhash)
+	{
+		maxhash=maxhash?maxhash*2:4096;
+		if((p=realloc(hash,maxhash*16))==NULL)
+		{
+			printf("Out of memory at %lu hashes\n",nhash);
+			return -1;
+		}
+		hash=p;
+	}
+	memcpy(hash+nhash*16,h,16);
+	nhash++;
+	return 0;
+}
+
+int iszero(const unsigned char *p, unsigned int n)
+{
+	while(n>0 && *p==0)
+	{
+		p++;
+		n--;
+	}
+	return n==0;
+}
+
+/* hash the blocks of a file; returns -1 only when out of memory */
+int add_file(const char *fn, unsigned char *buf, unsigned int bsize)
+{
+	FILE *f;
+	md5_ctx c;
+	unsigned char h[16];
+	unsigned int n;
+	int res=0;
+	if((f=fopen(fn,"rb"))==NULL)
+	{
+		printf("Unable to open %s, skipped\n",fn);
+		return 0;
+	}
+	while(res==0 && (n=fread(buf,1,bsize,f))>0)
+	{
+		memset(buf+n,0,bsize-n);
+		if(iszero(buf,bsize))
+			continue;
+		md5_init(&c);
+		md5_update(&c,buf,bsize);
+		md5_final(&c,h);
+		res=add(h);
+	}
+	fclose(f);
+	return res;
+}
+
+int add_list(const char *fn)
+{
+	FILE *f;
+	char line[256];
+	unsigned char h[16];
+	unsigned int i, v;
+	int res=0;
+	if((f=fopen(fn,"rt"))==NULL)
+	{
+		printf("Unable to open %s\n",fn);
+		return -1;
+	}
+	while(res==0 && fgets(line,sizeof(line),f)!=NULL)
+	{
+		for(i=0;i<16 && sscanf(line+2*i,"%2x",&v)==1;i++)
+			h[i]=(unsigned char)v;
+		if(i==16 && strspn(line,"0123456789ABCDEFabcdef")>=32)
+			res=add(h);
+	}
+	fclose(f);
+	return res;
+}
+
+int cmp(const void *a, const void *b)
+{
+	return memcmp(a,b,16);
+}
+
+void put(FILE *f, unsigned long v)
+{
+	unsigned char b[4];
+	put32le(b,v);
+	fwrite(b,4,1,f);
+}
+
+int main(int argc,char *argv[])
+{
+	char *db=NULL, *names=NULL, *list=NULL;
+	char line[256];
+	unsigned char *buf, *filter, hdr[KB_HDRLEN];
+	unsigned long bsize=4096, i, j, bit[KB_K];
+	unsigned int b;
+	int lbits, k, res=0;
+	FILE *f;
+
+	for(k=1;k<argc && argv[k][0]=='-';k++)
+	{
+		if(strncmp(argv[k],"-b=",3)==0)
+			bsize=atol(argv[k]+3);
+		else if(strncmp(argv[k],"-f=",3)==0)
+			names=argv[k]+3;
+		else if(strncmp(argv[k],"-l=",3)==0)
+			list=argv[k]+3;
+		else
+			break;
+	}
+	if(k>=argc || argv[k][0]=='-' || bsize==0 || bsize%512 || bsize>32768UL)
+	{
+		print_usage();
+		return 2;
+	}
+	db=argv[k++];
+	if((buf=malloc((unsigned int)bsize))==NULL)
+		return 2;
+	for(;k<argc && res==0;k++)
+		res=add_file(argv[k],buf,(unsigned int)bsize);
+	if(res==0 && names!=NULL)
+	{
+		if((f=fopen(names,"rt"))==NULL)
+		{
+			printf("Unable to open %s\n",names);
+			return 2;
+		}
+		while(res==0 && fgets(line,sizeof(line),f)!=NULL)
+		{
+			line[strcspn(line,"\r\n")]=0;
+			if(line[0])
+				res=add_file(line,buf,(unsigned int)bsize);
+		}
+		fclose(f);
+	}
+	if(res==0 && list!=NULL)
+		res=add_list(list);
+	if(res!=0)
+		return 2;
+
+	/* sorted and without duplicates, a block shared by many files is one hash */
+	if(nhash>0)
+		qsort(hash,(size_t)nhash,16,cmp);
+	for(i=j=0;i<nhash;i++)
+		if(j==0 || memcmp(hash+i*16,hash+(j-1)*16,16)!=0)
+			memmove(hash+(j++)*16,hash+i*16,16);
+	nhash=j;
+
+	/* about 16 filter bits per hash: few false hits with 4 bits each */
+	for(lbits=KB_MINBITS;lbits<KB_MAXBITS && (1UL<<lbits)<nhash*16;lbits++)
+		;
+	if((filter=calloc((size_t)(1UL<<(lbits-3)),1))==NULL)
+		return 2;
+	for(i=0;i<nhash;i++)
+	{
+		kb_bits(hash+i*16,lbits,bit);
+		for(k=0;k<KB_K;k++)
+			filter[bit[k]>>3]|=1<<(int)(bit[k]&7);
+	}
+	if((f=fopen(db,"wb"))==NULL)
+	{
+		printf("Unable to create %s\n",db);
+		return 2;
+	}
+	memset(hdr,0,KB_HDRLEN);
+	memcpy(hdr,KB_MAGIC,16);
+	put32le(hdr+16,bsize);
+	put32le(hdr+20,nhash);
+	hdr[24]=(unsigned char)lbits;
+	fwrite(hdr,KB_HDRLEN,1,f);
+	for(b=0,i=0;b<=KB_NBUCKET;b++)	/* first hash of each 12 bit prefix */
+	{
+		while(i<nhash && (unsigned int)(hash[i*16]<<4|hash[i*16+1]>>4)<b)
+			i++;
+		put(f,i);
+	}
+	fwrite(filter,(size_t)(1UL<<(lbits-3)),1,f);
+	if(nhash>0)
+		fwrite(hash,16,(size_t)nhash,f);
+	if(fclose(f)!=0)
+	{
+		printf("Error writing %s\n",db);
+		return 1;
+	}
+	printf("%s: %lu blocks of %lu bytes, filter of %lu KB\n",db,nhash,bsize,1UL<<(lbits-13));
+	return 0;
+}
@@ -0,0 +1,204 @@
+/* rawmerge - combine several partial rawhdd images of the same drive.
+ * Each input image comes with the log of the runs that wrote it. For every
+ * track the merged image gets a copy from an image where the whole track
+ * was read; failing that, each sector comes from an image where it was
+ * read. Sectors read by no image are reported as holes. The merge is
+ * logged like a rawhdd session, so "rawhdd -r" can fill the holes later.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rhmap.h"
+
+#define MAXIMG	8
+
+typedef struct srcimg
+{
+	char	*fn;
+	char	*log;
+	FILE	*f;
+	rhmap	map;
+} srcimg;
+
+srcimg src[MAXIMG];
+int nsrc=0;
+
+void print_usage()
+{
+	printf("Usage: rawmerge [-l=logfile] <dst_file> <image>[,log] <image>[,log]...\n");
+	printf("Merges partial images of one drive into dst_file. The log of each image\n");
+	printf("(default rawhdd.log) tells which of its sectors were read. The merge is\n");
+	printf("logged to logfile (default rawhdd.log); sectors no image has are holes,\n");
+	printf("which rawhdd -r=logfile dst_file can try to read again.\n");
+	printf("At most %d images.\n",MAXIMG);
+}
+
+/* read track trk of image i; returns 0 on success */
+int get_track(int i, unsigned long trk, char *buf, unsigned int tb)
+{
+	if(fseek(src[i].f,(long)trk*tb,SEEK_SET)!=0)
+		return -1;
+	return fread(buf,tb,1,src[i].f)==1?0:-1;
+}
+
+int main(int argc,char *argv[])
+{
+	char *fn=NULL;
+	char *logname="rawhdd.log";
+	char *p;
+	FILE *out, *lf;
+	rhmap *m;
+	rhext holes;
+	char *buf, *tbuf;
+	unsigned int tb, s;
+	unsigned long trk, whole=0, part=0, none=0;
+	unsigned char have[64];	/* sector s was found in some image */
+	int i, got;
+	time_t t;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strncmp(argv[i],"-l=",3)==0)
+			logname=argv[i]+3;
+		else if(argv[i][0]=='-')
+		{
+			print_usage();
+			return 2;
+		}
+		else if(fn==NULL)
+			fn=argv[i];
+		else if(nsrc<MAXIMG)
+		{
+			src[nsrc].fn=argv[i];
+			src[nsrc].log="rawhdd.log";
+			if((p=strchr(argv[i],','))!=NULL)
+			{
+				*p=0;
+				src[nsrc].log=p+1;
+			}
+			nsrc++;
+		}
+		else
+		{
+			print_usage();
+			return 2;
+		}
+	}
+	if(fn==NULL || nsrc==0)
+	{
+		print_usage();
+		return 2;
+	}
+
+	for(i=0;i<nsrc;i++)
+	{
+		m=&src[i].map;
+		m->tracks=0;
+		if(map_import(m,src[i].log,src[i].fn)<=0)
+		{
+			printf("No session for %s found in %s\n",src[i].fn,src[i].log);
+			return 2;
+		}
+		if(m->tracks!=src[0].map.tracks || m->heads!=src[0].map.heads || m->sectors!=src[0].map.sectors)
+		{
+			printf("%s: geometry differs from %s\n",src[i].fn,src[0].fn);
+			return 2;
+		}
+		if((src[i].f=fopen(src[i].fn,"rb"))==NULL)
+		{
+			printf("Unable to open %s\n",src[i].fn);
+			return 2;
+		}
+		printf("%s: %lu of %lu tracks complete, %u bad sectors\n",src[i].fn,
+			map_count(m),map_ntracks(m),m->nbad);
+	}
+	m=&src[0].map;
+	tb=512*m->sectors;
+	buf=malloc(tb);
+	tbuf=malloc(tb);
+	if(buf==NULL || tbuf==NULL)
+	{
+		printf("malloc failed\n");
+		return 2;
+	}
+	if((out=fopen(fn,"wb"))==NULL || (lf=fopen(logname,"at"))==NULL)
+	{
+		printf("Unable to create %s\n",out==NULL?fn:logname);
+		return 2;
+	}
+	t=time(NULL);
+	fprintf(lf,"\n%s copy started at %s\n",fn,asctime(localtime(&t)));
+	fprintf(lf,"Drive 0 CHS: %u,%u,%u\n",m->tracks,m->heads,m->sectors);
+	fprintf(lf,"Merged from %d images\n",nsrc);
+	ext_init(&holes,"HOLE",lf);
+
+	for(trk=0;trk<map_ntracks(m);trk++)
+	{
+		/* prefer an image that read the whole track */
+		for(i=0;i<nsrc;i++)
+			if(map_done(&src[i].map,trk) && get_track(i,trk,buf,tb)==0)
+				break;
+		if(i<nsrc)
+		{
+			fprintf(lf,"OK: %lu,%lu,*\n",trk/m->heads,trk%m->heads);
+			whole++;
+		}
+		else
+		{
+			/* sector by sector, first image that read it wins */
+			memset(buf,0,tb);
+			memset(have,0,sizeof(have));
+			got=0;
+			for(i=0;i<nsrc;i++)
+			{
+				if(!map_seen(&src[i].map,trk) || get_track(i,trk,tbuf,tb)!=0)
+					continue;
+				got=1;
+				for(s=1;s<=m->sectors;s++)
+					if(!have[s] && !map_isbad(&src[i].map,MAP_LBA(m,trk,s)))
+					{
+						memcpy(buf+(s-1)*512,tbuf+(s-1)*512,512);
+						have[s]=1;
+					}
+			}
+			if(got)
+				part++;
+			else
+				none++;	/* not logged at all, rawhdd -r reads it */
+			for(s=1;s<=m->sectors;s++)
+			{
+				if(!have[s])
+					ext_add(&holes,MAP_LBA(m,trk,s));
+				if(got)
+					fprintf(lf,"%s: %lu,%lu,%u\n",have[s]?"OK":"ERR",
+						trk/m->heads,trk%m->heads,s);
+			}
+		}
+		if(fwrite(buf,tb,1,out)!=1)
+		{
+			printf("Error writing %s\n",fn);
+			return 1;
+		}
+	}
+	ext_flush(&holes);
+	printf("%lu tracks complete, %lu merged by sector, %lu missing; %lu sectors in holes\n",
+		whole,part,none,holes.total);
+	fprintf(lf,"Merge: %lu sectors in holes (%lu runs)\n",holes.total,holes.runs);
+	t=time(NULL);
+	fprintf(lf,"%s copy finished at %s\n",fn,asctime(localtime(&t)));
+	fclose(out);
+	fclose(lf);
+	for(i=0;i<nsrc;i++)
+	{
+		fclose(src[i].f);
+		map_free(&src[i].map);
+	}
+	free(buf);
+	free(tbuf);
+	return 0;
+}
@@ -0,0 +1,219 @@
+/* rawmkl - check a range of tracks of a rawhdd image against its Merkle
+ * root (rawhdd -m=1). Only the tracks in the range are read from the
+ * image; each is hashed and compared with its leaf in image.MKL, and the
+ * root is recomputed from the fresh hashes and the leaves of the other
+ * tracks (which stand in for the audit path). A leaf edited to match a
+ * changed track therefore still fails against the root, which should be
+ * taken from rawhdd.log (-r) when the .MKL itself is not trusted.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aes.h"
+#include "merkle.h"
+#include "rhimg.h"
+#include "rhmap.h"
+
+void print_usage()
+{
+	printf("Usage: rawmkl [-e=keyfile] [-s=sectors] [-f=first_track] [-n=tracks] [-r=root] <image>\n");
+	printf("Checks a range of tracks against the Merkle tree in image.MKL (written by\n");
+	printf("rawhdd -m=1): each track against its leaf, and all leaves against the root.\n");
+	printf("-r gives the root as logged in rawhdd.log instead of the one in image.MKL.\n");
+	printf("-s gives the sectors per track of images that don't record the geometry.\n");
+}
+
+/* parse 64 hex digits */
+int get_root(const char *s, unsigned char *root)
+{
+	unsigned int i, v;
+
+	if(strlen(s)!=2*MK_HASHLEN)
+		return -1;
+	for(i=0;i<MK_HASHLEN;i++)
+	{
+		if(sscanf(s+2*i,"%2x",&v)!=1)
+			return -1;
+		root[i]=(unsigned char)v;
+	}
+	return 0;
+}
+
+/* print a range of bad tracks */
+void report(unsigned long first, unsigned long last)
+{
+	if(first==last)
+		printf("BAD: track %lu\n",first);
+	else
+		printf("BAD: tracks %lu-%lu\n",first,last);
+}
+
+int main(int argc,char *argv[])
+{
+	char *fn=NULL;
+	char mkname[NAMELEN];
+	rhimg im;
+	FILE *mf;
+	mk_ctx c;
+	unsigned char key[AES_KEYLEN];
+	unsigned char root[MK_HASHLEN], sum[MK_HASHLEN];
+	unsigned char leaf[MK_HASHLEN], h[MK_HASHLEN];
+	unsigned long first=0, count=0xffffffffUL;
+	unsigned long nleaves, size, trk, nbad=0, nchk=0, badstart=0;
+	unsigned int spt=0;
+	int haveroot=0, inbad=0;
+	char *buf;
+	int i;
+
+	for(i=1;i<argc;i++)
+	{
+		if(argv[i][0]!='-')
+		{
+			if(fn!=NULL)
+			{
+				print_usage();
+				return 2;
+			}
+			fn=argv[i];
+		}
+		else if(strncmp(argv[i],"-e=",3)==0)
+		{
+			if(aes_keyfile(argv[i]+3,key)!=0)
+			{
+				printf("Unable to read key file %s\n",argv[i]+3);
+				return 2;
+			}
+			img_key(key);
+		}
+		else if(strncmp(argv[i],"-s=",3)==0)
+			spt=atoi(argv[i]+3);
+		else if(strncmp(argv[i],"-f=",3)==0)
+			first=atol(argv[i]+3);
+		else if(strncmp(argv[i],"-n=",3)==0)
+			count=atol(argv[i]+3);
+		else if(strncmp(argv[i],"-r=",3)==0)
+		{
+			if(get_root(argv[i]+3,root)!=0)
+			{
+				printf("The root is 64 hex digits\n");
+				return 2;
+			}
+			haveroot=1;
+		}
+		else
+		{
+			print_usage();
+			return 2;
+		}
+	}
+	if(fn==NULL)
+	{
+		print_usage();
+		return 2;
+	}
+	if(img_open(&im,fn)!=0)
+	{
+		printf("Unable to open image %s\n",fn);
+		return 2;
+	}
+	if(spt==0)
+		spt=im.spt;
+	if(spt==0 || spt>63)
+	{
+		printf("%s doesn't record the geometry, give the sectors per track with -s\n",fn);
+		return 2;
+	}
+	if(sidecar(mkname,sizeof(mkname),fn,"MKL")!=0)
+		return 2;
+	if((mf=fopen(mkname,"rb"))==NULL)
+	{
+		printf("Unable to open %s\n",mkname);
+		return 2;
+	}
+	nleaves=im.sectors/spt;
+	if(fseek(mf,0L,SEEK_END)!=0 || (size=ftell(mf))<nleaves*MK_HASHLEN)
+	{
+		printf("%s has fewer than the %lu leaves of the image\n",mkname,nleaves);
+		return 2;
+	}
+	if(!haveroot)
+	{
+		if(size<(nleaves+1)*MK_HASHLEN || fseek(mf,(long)nleaves*MK_HASHLEN,SEEK_SET)!=0 ||
+			fread(root,MK_HASHLEN,1,mf)!=1)
+		{
+			printf("%s holds no root (copy was not finished), give it with -r\n",mkname);
+			return 2;
+		}
+	}
+	if(first>=nleaves)
+	{
+		printf("The image has %lu tracks\n",nleaves);
+		return 2;
+	}
+	if(count>nleaves-first)
+		count=nleaves-first;
+	if((buf=malloc(spt*512))==NULL)
+	{
+		printf("malloc failed\n");
+		return 2;
+	}
+
+	/* leaves before and after the range are taken as they are */
+	fseek(mf,0L,SEEK_SET);
+	mk_start(&c);
+	for(trk=0;trk<nleaves;trk++)
+	{
+		if(fread(leaf,MK_HASHLEN,1,mf)!=1)
+		{
+			printf("Error reading %s\n",mkname);
+			return 2;
+		}
+		if(trk<first || trk>=first+count)
+		{
+			mk_add(&c,leaf);
+			continue;
+		}
+		if(img_read(&im,trk*spt,spt,buf)!=0)
+		{
+			printf("Error reading image at LBA %lu\n",trk*spt);
+			return 2;
+		}
+		mk_hash(h,buf,spt*512);
+		mk_add(&c,h);
+		nchk++;
+		if(memcmp(h,leaf,MK_HASHLEN)!=0)
+		{
+			nbad++;
+			if(!inbad)
+			{
+				badstart=trk;
+				inbad=1;
+			}
+		}
+		else if(inbad)
+		{
+			report(badstart,trk-1);
+			inbad=0;
+		}
+	}
+	if(inbad)
+		report(badstart,first+count-1);
+	mk_end(&c,sum);
+	free(buf);
+	fclose(mf);
+	img_close(&im);
+
+	printf("%lu tracks checked, %lu bad\n",nchk,nbad);
+	if(memcmp(sum,root,MK_HASHLEN)!=0)
+	{
+		printf("BAD: the tracks and the other leaves don't give the root%s\n",
+			haveroot?"":" in the .MKL");
+		return 1;
+	}
+	printf("Root matches\n");
+	return nbad?1:0;
+}
@@ -0,0 +1,411 @@
+/* rawnbd - serve rawhdd images read-only over NBD (network block device).
+ * Any image rhimg.c reads (raw, stripe set, segments, frame file, E01,
+ * qcow2, encrypted) can be attached as a block device without extracting it, e.g.
+ *	rawnbd -u=/tmp/disk.sock disk.E01
+ *	nbd-client -unix /tmp/disk.sock /dev/nbd0 -name disk.E01
+ * Listens on a Unix socket or on a localhost TCP port; each connection
+ * gets its own process and image handle (with its own chunk cache), so
+ * several clients read at once. After answering a sequential read, the
+ * next chunk is read ahead while the client has nothing else pending.
+ * POSIX only: this runs on the storage host, not under DOS.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "rhimg.h"
+#include "aes.h"
+
+#define NBD_MAGIC	0x4e42444d41474943ULL	/* "NBDMAGIC" */
+#define NBD_OPTMAGIC	0x49484156454f5054ULL	/* "IHAVEOPT" */
+#define NBD_REPMAGIC	0x3e889045565a9ULL
+#define NBD_REQMAGIC	0x25609513UL
+#define NBD_SIMPLEMAGIC	0x67446698UL
+
+#define OPT_EXPORT_NAME	1
+#define OPT_ABORT	2
+#define OPT_LIST	3
+#define OPT_INFO	6
+#define OPT_GO		7
+
+#define REP_ACK		1
+#define REP_SERVER	2
+#define REP_INFO	3
+#define REP_ERR_UNSUP	0x80000001UL
+#define REP_ERR_UNKNOWN	0x80000006UL
+
+#define CMD_READ	0
+#define CMD_WRITE	1
+#define CMD_DISC	2
+#define CMD_FLUSH	3
+
+/* transmission flags: has flags, read only, flush, multiple connections */
+#define TFLAGS		(1|2|4|256)
+
+#define MAXREQ		(32UL<<20)	/* largest read served */
+#define AHEAD		64		/* sectors read ahead at least */
+
+#define MAXEXP		16
+
+char *exports[MAXEXP];	/* image file names, also the export names */
+int nexp=0;
+
+void print_usage()
+{
+	printf("Usage: rawnbd [-u=socket_path | -p=tcp_port] [-e=keyfile] <image> [image]...\n");
+	printf("Serves the images read-only over NBD, under their file names as export\n");
+	printf("names (an empty name is the first image). TCP listens on localhost only.\n");
+	printf("-e=keyfile is the key of encrypted (-o=aes) images.\n");
+}
+
+int readn(int fd, void *p, size_t n)
+{
+	ssize_t r;
+	char *c=p;
+	while(n>0)
+	{
+		if((r=read(fd,c,n))<=0)
+			return -1;
+		c+=r;
+		n-=r;
+	}
+	return 0;
+}
+
+int writen(int fd, const void *p, size_t n)
+{
+	ssize_t r;
+	const char *c=p;
+	while(n>0)
+	{
+		if((r=write(fd,c,n))<=0)
+			return -1;
+		c+=r;
+		n-=r;
+	}
+	return 0;
+}
+
+void put_be(unsigned char *p, uint64_t v, int n)
+{
+	while(n-->0)
+	{
+		p[n]=(unsigned char)v;
+		v>>=8;
+	}
+}
+
+uint64_t get_be(const unsigned char *p, int n)
+{
+	uint64_t v=0;
+	while(n-->0)
+		v=(v<<8)|*p++;
+	return v;
+}
+
+int opt_reply(int fd, uint32_t opt, uint32_t type, const void *data, uint32_t len)
+{
+	unsigned char h[20];
+	put_be(h,NBD_REPMAGIC,8);
+	put_be(h+8,opt,4);
+	put_be(h+12,type,4);
+	put_be(h+16,len,4);
+	if(writen(fd,h,20)!=0)
+		return -1;
+	return len?writen(fd,data,len):0;
+}
+
+/* export by name; "" is the first one */
+int find_export(const char *name)
+{
+	int i;
+	if(name[0]==0)
+		return 0;
+	for(i=0;i<nexp;i++)
+		if(strcmp(name,exports[i])==0)
+			return i;
+	return -1;
+}
+
+/* option haggling (fixed newstyle); returns the export to serve or -1 */
+int handshake(int fd, rhimg *im)
+{
+	unsigned char h[20], info[12];
+	char *data=NULL;
+	uint32_t opt, len, nl;
+	int e, cflags;
+
+	put_be(h,NBD_MAGIC,8);
+	put_be(h+8,NBD_OPTMAGIC,8);
+	put_be(h+16,1|2,2);	/* fixed newstyle, no zeroes */
+	if(writen(fd,h,18)!=0 || readn(fd,h,4)!=0)
+		return -1;
+	cflags=(int)get_be(h,4);
+	for(;;)
+	{
+		free(data);
+		data=NULL;
+		if(readn(fd,h,16)!=0 || get_be(h,8)!=NBD_OPTMAGIC)
+			return -1;
+		opt=(uint32_t)get_be(h+8,4);
+		len=(uint32_t)get_be(h+12,4);
+		if(len>4096 || (data=malloc(len+1))==NULL || readn(fd,data,len)!=0)
+			return -1;
+		data[len]=0;
+		switch(opt)
+		{
+			case OPT_EXPORT_NAME:
+				if((e=find_export(data))<0 || img_open(im,exports[e])!=0)
+					return -1;
+				put_be(h,(uint64_t)im->sectors*512,8);
+				put_be(h+8,TFLAGS,2);
+				if(writen(fd,h,10)!=0)
+					return -1;
+				if(!(cflags&2))	/* client wants the old padding */
+				{
+					memset(data=realloc(data,124),0,124);
+					if(writen(fd,data,124)!=0)
+						return -1;
+				}
+				free(data);
+				return e;
+			case OPT_ABORT:
+				opt_reply(fd,opt,REP_ACK,NULL,0);
+				return -1;
+			case OPT_LIST:
+				for(e=0;e<nexp;e++)
+				{
+					nl=(uint32_t)strlen(exports[e]);
+					if((data=realloc(data,nl+4))==NULL)
+						return -1;
+					put_be((unsigned char *)data,nl,4);
+					memcpy(data+4,exports[e],nl);
+					if(opt_reply(fd,opt,REP_SERVER,data,nl+4)!=0)
+						return -1;
+				}
+				if(opt_reply(fd,opt,REP_ACK,NULL,0)!=0)
+					return -1;
+				break;
+			case OPT_INFO:
+			case OPT_GO:
+				if(len<6 || (nl=(uint32_t)get_be((unsigned char *)data,4))>len-6)
+					return -1;
+				data[4+nl]=0;	/* requested info types are ignored */
+				if((e=find_export(data+4))<0 || img_open(im,exports[e])!=0)
+				{
+					if(opt_reply(fd,opt,REP_ERR_UNKNOWN,NULL,0)!=0)
+						return -1;
+					break;
+				}
+				put_be(info,0,2);	/* NBD_INFO_EXPORT */
+				put_be(info+2,(uint64_t)im->sectors*512,8);
+				put_be(info+10,TFLAGS,2);
+				if(opt_reply(fd,opt,REP_INFO,info,12)!=0 ||
+					opt_reply(fd,opt,REP_ACK,NULL,0)!=0)
+					return -1;
+				if(opt==OPT_GO)
+				{
+					free(data);
+					return e;
+				}
+				img_close(im);
+				break;
+			default:
+				if(opt_reply(fd,opt,REP_ERR_UNSUP,NULL,0)!=0)
+					return -1;
+		}
+	}
+}
+
+/* bytes [off,off+len) of the image; the ends need not be sector aligned */
+int read_bytes(rhimg *im, uint64_t off, uint32_t len, unsigned char *out, unsigned char *tmp)
+{
+	unsigned long lba=(unsigned long)(off/512), n;
+	unsigned int skip=(unsigned int)(off%512);
+
+	n=(unsigned long)((skip+len+511)/512);
+	if(off+len>(uint64_t)im->sectors*512)
+		return -1;
+	if(img_read(im,lba,(unsigned int)n,tmp)!=0)
+		return -1;
+	memcpy(out,tmp+skip,len);
+	return 0;
+}
+
+void serve(int fd)
+{
+	rhimg im;
+	unsigned char h[28], r[16];
+	unsigned char *buf, *tmp;
+	uint32_t type, len, err;
+	uint64_t off, next=0;
+	unsigned long lba, ahead;
+	struct pollfd pf;
+
+	if(handshake(fd,&im)<0)
+		return;
+	buf=malloc(MAXREQ);
+	tmp=malloc(MAXREQ+1024);
+	if(buf==NULL || tmp==NULL)
+		return;
+	ahead=im.csect>AHEAD?im.csect:AHEAD;
+	for(;;)
+	{
+		if(readn(fd,h,28)!=0 || get_be(h,4)!=NBD_REQMAGIC)
+			break;
+		type=(uint32_t)get_be(h+6,2);
+		off=get_be(h+16,8);
+		len=(uint32_t)get_be(h+24,4);
+		put_be(r,NBD_SIMPLEMAGIC,4);
+		memcpy(r+8,h+8,8);	/* handle */
+		if(type==CMD_DISC)
+			break;
+		if(type==CMD_READ)
+		{
+			err=len>MAXREQ?22:read_bytes(&im,off,len,buf,tmp)!=0?5:0;
+			put_be(r+4,err,4);
+			if(writen(fd,r,16)!=0 || (err==0 && writen(fd,buf,len)!=0))
+				break;
+			/* sequential reader and nothing else waiting: read on */
+			if(err==0 && off==next && off+len<(uint64_t)im.sectors*512)
+			{
+				pf.fd=fd;
+				pf.events=POLLIN;
+				lba=(unsigned long)((off+len+511)/512);
+				if(poll(&pf,1,0)==0)
+					img_read(&im,lba,(unsigned int)(im.sectors-lba<ahead?im.sectors-lba:ahead),tmp);
+			}
+			next=off+len;
+			continue;
+		}
+		/* read only: flush is a no-op, anything else is refused;
+		 * a write still carries its data, which has to be skipped */
+		if(type==CMD_WRITE && (len>MAXREQ || readn(fd,buf,len)!=0))
+			break;
+		put_be(r+4,type==CMD_FLUSH?0:type==CMD_WRITE?1:22,4);
+		if(writen(fd,r,16)!=0)
+			break;
+	}
+	img_close(&im);
+	free(buf);
+	free(tmp);
+}
+
+int main(int argc, char *argv[])
+{
+	char *sock=NULL;
+	int port=0, i, ls, fd, one=1;
+	struct sockaddr_un su;
+	struct sockaddr_in si;
+	rhimg im;
+	unsigned char key[AES_KEYLEN];
+
+	for(i=1;i<argc;i++)
+	{
+		if(strncmp(argv[i],"-u=",3)==0)
+			sock=argv[i]+3;
+		else if(strncmp(argv[i],"-p=",3)==0)
+			port=atoi(argv[i]+3);
+		else if(strncmp(argv[i],"-e=",3)==0)
+		{
+			if(aes_keyfile(argv[i]+3,key)!=0)
+			{
+				printf("Unable to read key file %s\n",argv[i]+3);
+				return 2;
+			}
+			img_key(key);
+		}
+		else if(argv[i][0]=='-' || nexp==MAXEXP)
+		{
+			print_usage();
+			return 2;
+		}
+		else
+			exports[nexp++]=argv[i];
+	}
+	if(nexp==0 || (sock==NULL)==(port==0))
+	{
+		print_usage();
+		return 2;
+	}
+	for(i=0;i<nexp;i++)	/* fail now rather than at the first client */
+	{
+		if(img_open(&im,exports[i])!=0)
+		{
+			printf("Unable to open image %s\n",exports[i]);
+			return 2;
+		}
+		printf("%s: %lu sectors\n",exports[i],im.sectors);
+		img_close(&im);
+	}
+
+	if(sock!=NULL)
+	{
+		memset(&su,0,sizeof(su));
+		su.sun_family=AF_UNIX;
+		if(strlen(sock)>=sizeof(su.sun_path))
+		{
+			printf("Socket path too long\n");
+			return 2;
+		}
+		strcpy(su.sun_path,sock);
+		unlink(sock);
+		ls=socket(AF_UNIX,SOCK_STREAM,0);
+		if(ls<0 || bind(ls,(struct sockaddr *)&su,sizeof(su))!=0)
+		{
+			perror(sock);
+			return 2;
+		}
+	}
+	else
+	{
+		memset(&si,0,sizeof(si));
+		si.sin_family=AF_INET;
+		si.sin_port=htons((unsigned short)port);
+		si.sin_addr.s_addr=htonl(INADDR_LOOPBACK);
+		ls=socket(AF_INET,SOCK_STREAM,0);
+		if(ls>=0)
+			setsockopt(ls,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+		if(ls<0 || bind(ls,(struct sockaddr *)&si,sizeof(si))!=0)
+		{
+			perror("bind");
+			return 2;
+		}
+	}
+	if(listen(ls,8)!=0)
+	{
+		perror("listen");
+		return 2;
+	}
+	signal(SIGCHLD,SIG_IGN);	/* children reap themselves */
+	signal(SIGPIPE,SIG_IGN);
+	printf("Serving %d image(s) on %s\n",nexp,sock!=NULL?sock:"localhost");
+	fflush(stdout);
+	for(;;)
+	{
+		if((fd=accept(ls,NULL,NULL))<0)
+			continue;
+		if(port)
+			setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+		if(fork()==0)
+		{
+			close(ls);
+			serve(fd);
+			close(fd);
+			_exit(0);
+		}
+		close(fd);
+	}
+}
@@ -0,0 +1,567 @@
+/* rawput - upload images, logs and hashes to an S3 compatible store.
+ * A file (or standard input, e.g. a -o=frame stream coming off a serial
+ * line or pipe) goes up as one object without being staged on disk:
+ * it is cut into parts that are uploaded as a multipart object, several
+ * at a time, each by its own process with its own retries. Memory use is
+ * bounded by (jobs+1)*part size. Small files go up with a single PUT.
+ *	rawput http://127.0.0.1:9000/archive/disk7/ DISK.FRM rawhdd.log DISK.MKL
+ *	rawput -n=DISK.FRM http://127.0.0.1:9000/archive/disk7/ - < /dev/ttyS0
+ * Requests are signed (AWS Signature Version 4) with AWS_ACCESS_KEY_ID,
+ * AWS_SECRET_ACCESS_KEY and AWS_REGION (default us-east-1) from the
+ * environment. Plain HTTP only; put a TLS proxy in front for remote
+ * stores. POSIX only: this runs on the storage host, not under DOS.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "sha256.h"
+
+#define MAXPARTS	10000	/* S3 limit */
+#define MAXJOBS		16
+#define RETRIES		5
+
+char host[256], port[8], bucket[256], prefix[512];
+const char *akey, *skey, *region;
+int jobs=4;
+unsigned long partsize=16UL<<20;
+
+void print_usage()
+{
+	printf("Usage: rawput [-j=jobs] [-p=part_MB] [-n=name] http://host[:port]/bucket/[prefix]\n");
+	printf("              <file|-> [file]...\n");
+	printf("Uploads each file as object prefix+file name (- is standard input, named\n");
+	printf("by -n). Files larger than a part (-p, default 16 MB) go up as multipart\n");
+	printf("objects, -j parts at a time (default 4). Credentials come from\n");
+	printf("AWS_ACCESS_KEY_ID, AWS_SECRET_ACCESS_KEY and AWS_REGION.\n");
+}
+
+void hex(const unsigned char *p, int n, char *out)
+{
+	while(n-->0)
+	{
+		sprintf(out,"%02x",*p++);
+		out+=2;
+	}
+}
+
+void sha_hex(const void *p, unsigned long n, char out[65])
+{
+	sha256_ctx c;
+	unsigned char d[32];
+	sha256_init(&c);
+	sha256_update(&c,p,(unsigned int)n);
+	sha256_final(&c,d);
+	hex(d,32,out);
+}
+
+void hmac(const unsigned char *k, unsigned int kl, const char *msg, unsigned char out[32])
+{
+	sha256_ctx c;
+	unsigned char pad[64], kh[32];
+	int i;
+
+	if(kl>64)
+	{
+		sha256_init(&c);
+		sha256_update(&c,k,kl);
+		sha256_final(&c,kh);
+		k=kh;
+		kl=32;
+	}
+	memset(pad,0x36,64);
+	for(i=0;i<(int)kl;i++)
+		pad[i]^=k[i];
+	sha256_init(&c);
+	sha256_update(&c,pad,64);
+	sha256_update(&c,msg,(unsigned int)strlen(msg));
+	sha256_final(&c,out);
+	for(i=0;i<64;i++)
+		pad[i]^=0x36^0x5c;
+	sha256_init(&c);
+	sha256_update(&c,pad,64);
+	sha256_update(&c,out,32);
+	sha256_final(&c,out);
+}
+
+/* URI encoding as SigV4 wants it; '/' is kept in paths */
+void uri_encode(const char *s, int path, char *out)
+{
+	for(;*s;s++)
+	{
+		if(isalnum((unsigned char)*s) || strchr("-._~",*s) || (path && *s=='/'))
+			*out++=*s;
+		else
+		{
+			sprintf(out,"%%%02X",(unsigned char)*s);
+			out+=3;
+		}
+	}
+	*out=0;
+}
+
+int connect_host()
+{
+	struct addrinfo hints, *ai, *a;
+	int fd=-1;
+
+	memset(&hints,0,sizeof(hints));
+	hints.ai_socktype=SOCK_STREAM;
+	if(getaddrinfo(host,port,&hints,&ai)!=0)
+		return -1;
+	for(a=ai;a!=NULL;a=a->ai_next)
+	{
+		if((fd=socket(a->ai_family,a->ai_socktype,a->ai_protocol))<0)
+			continue;
+		if(connect(fd,a->ai_addr,a->ai_addrlen)==0)
+			break;
+		close(fd);
+		fd=-1;
+	}
+	freeaddrinfo(ai);
+	return fd;
+}
+
+int writen(int fd, const void *p, unsigned long n)
+{
+	ssize_t r;
+	const char *c=p;
+	while(n>0)
+	{
+		if((r=write(fd,c,n))<=0)
+			return -1;
+		c+=r;
+		n-=r;
+	}
+	return 0;
+}
+
+/* undo chunked transfer coding in place */
+void unchunk(char *body)
+{
+	char *in=body, *out=body, *e;
+	unsigned long n;
+	for(;;)
+	{
+		n=strtoul(in,&e,16);
+		if(e==in || n==0 || (in=strstr(e,"\r\n"))==NULL)
+			break;
+		in+=2;
+		if(strlen(in)<n)
+			n=strlen(in);
+		memmove(out,in,n);
+		out+=n;
+		in+=n;
+		if(strncmp(in,"\r\n",2)==0)
+			in+=2;
+	}
+	*out=0;
+}
+
+/* one signed request on its own connection; returns the HTTP status,
+ * the response head and body in *resp (to be freed), or -1 */
+int request(const char *method, const char *key, const char *query,
+	const char *body, unsigned long len, char **resp)
+{
+	char date[20], day[9], path[4096], hosthdr[300], phash[65], crhash[65];
+	char *creq, *sts, *hdr, *r=NULL, *p;
+	unsigned char k1[32], k2[32];
+	char sig[65], kstart[300];
+	time_t now=time(NULL);
+	unsigned long got=0, cap=0;
+	ssize_t n;
+	int fd, status;
+
+	*resp=NULL;
+	strftime(date,sizeof(date),"%Y%m%dT%H%M%SZ",gmtime(&now));
+	memcpy(day,date,8);
+	day[8]=0;
+	sprintf(path,"/%s/",bucket);
+	uri_encode(key,1,path+strlen(path));
+	if(strcmp(port,"80")==0)
+		strcpy(hosthdr,host);
+	else
+		sprintf(hosthdr,"%s:%s",host,port);
+	sha_hex(body,len,phash);
+
+	creq=malloc(strlen(path)+strlen(query)+strlen(hosthdr)+512);
+	sts=malloc(512);
+	hdr=malloc(strlen(path)+strlen(query)+strlen(hosthdr)+strlen(akey)+1024);
+	if(creq==NULL || sts==NULL || hdr==NULL)
+		return -1;
+	sprintf(creq,"%s\n%s\n%s\nhost:%s\nx-amz-content-sha256:%s\nx-amz-date:%s\n\n"
+		"host;x-amz-content-sha256;x-amz-date\n%s",
+		method,path,query,hosthdr,phash,date,phash);
+	sha_hex(creq,strlen(creq),crhash);
+	sprintf(sts,"AWS4-HMAC-SHA256\n%s\n%s/%s/s3/aws4_request\n%s",date,day,region,crhash);
+	snprintf(kstart,sizeof(kstart),"AWS4%s",skey);
+	hmac((unsigned char *)kstart,(unsigned int)strlen(kstart),day,k1);
+	hmac(k1,32,region,k2);
+	hmac(k2,32,"s3",k1);
+	hmac(k1,32,"aws4_request",k2);
+	hmac(k2,32,sts,k1);
+	hex(k1,32,sig);
+	sprintf(hdr,"%s %s%s%s HTTP/1.1\r\nHost: %s\r\nx-amz-date: %s\r\n"
+		"x-amz-content-sha256: %s\r\nAuthorization: AWS4-HMAC-SHA256 "
+		"Credential=%s/%s/%s/s3/aws4_request, SignedHeaders=host;x-amz-content-sha256;"
+		"x-amz-date, Signature=%s\r\nContent-Length: %lu\r\nConnection: close\r\n\r\n",
+		method,path,query[0]?"?":"",query,hosthdr,date,phash,akey,day,region,sig,len);
+	free(creq);
+	free(sts);
+
+	if((fd=connect_host())<0)
+	{
+		free(hdr);
+		return -1;
+	}
+	status=writen(fd,hdr,strlen(hdr))==0 && writen(fd,body,len)==0?0:-1;
+	free(hdr);
+	while(status==0)
+	{
+		if(cap-got<4096)
+		{
+			cap=cap?cap*2:16384;
+			if((p=realloc(r,cap+1))==NULL)
+			{
+				status=-1;
+				break;
+			}
+			r=p;
+		}
+		if((n=read(fd,r+got,cap-got))<=0)
+			break;
+		got+=n;
+	}
+	close(fd);
+	if(r!=NULL)
+		r[got]=0;
+	if(r==NULL || status!=0 || sscanf(r,"HTTP/%*s %d",&status)!=1)
+	{
+		free(r);
+		return -1;
+	}
+	if((p=strstr(r,"\r\n\r\n"))!=NULL && strstr(r,"chunked")!=NULL && strstr(r,"chunked")<p)
+		unchunk(p+4);
+	*resp=r;
+	return status;
+}
+
+/* value of header name in a response, copied to out */
+int header(const char *resp, const char *name, char *out, int max)
+{
+	const char *p=resp, *e=strstr(resp,"\r\n\r\n");
+	int n=(int)strlen(name), i=0;
+	while((p=strstr(p,"\r\n"))!=NULL && p<e)
+	{
+		p+=2;
+		if(strncasecmp(p,name,n)==0 && p[n]==':')
+		{
+			for(p+=n+1;*p==' ';p++)
+				;
+			while(*p && *p!='\r' && i<max-1)
+				out[i++]=*p++;
+			out[i]=0;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+/* text between <tag> and </tag> in the body */
+int xml_value(const char *resp, const char *tag, char *out, int max)
+{
+	char t[64];
+	const char *p, *e;
+	sprintf(t,"<%s>",tag);
+	if((p=strstr(resp,t))==NULL)
+		return -1;
+	p+=strlen(t);
+	sprintf(t,"</%s>",tag);
+	if((e=strstr(p,t))==NULL || e-p>=max)
+		return -1;
+	memcpy(out,p,e-p);
+	out[e-p]=0;
+	return 0;
+}
+
+/* request retried with backoff on network errors and 5xx answers */
+int request_retry(const char *method, const char *key, const char *query,
+	const char *body, unsigned long len, char **resp)
+{
+	int a, status=-1;
+	for(a=0;a<RETRIES;a++)
+	{
+		if(a>0)
+		{
+			free(*resp);
+			sleep(1<<(a-1));
+		}
+		status=request(method,key,query,body,len,resp);
+		if(status>=200 && status<500)
+			break;
+	}
+	return status;
+}
+
+/* reads up to n bytes, short only at end of file */
+unsigned long readfull(FILE *f, char *buf, unsigned long n)
+{
+	unsigned long got=0;
+	size_t r;
+	while(got<n && (r=fread(buf+got,1,n-got,f))>0)
+		got+=r;
+	return got;
+}
+
+/* child process: upload part, ETag goes to fd */
+void put_part(const char *key, const char *id, int no, const char *buf, unsigned long n, int fd)
+{
+	char q[600], eid[512], etag[128];
+	char *resp=NULL;
+	int status;
+	uri_encode(id,0,eid);
+	sprintf(q,"partNumber=%d&uploadId=%s",no,eid);
+	status=request_retry("PUT",key,q,buf,n,&resp);
+	if(status!=200 || header(resp,"ETag",etag,sizeof(etag))!=0)
+	{
+		fprintf(stderr,"Part %d of %s failed (HTTP %d)\n",no,key,status);
+		_exit(1);
+	}
+	writen(fd,etag,strlen(etag)+1);
+	_exit(0);
+}
+
+struct job
+{
+	pid_t	pid;
+	int	fd;
+	int	no;
+};
+
+int upload(FILE *f, const char *key)
+{
+	char *buf, *resp=NULL, *xml, *p;
+	char id[512], eid[512], q[600];
+	char (*etags)[128];
+	struct job job[MAXJOBS];
+	unsigned long n, total=0;
+	int nparts=0, running=0, failed=0, i, st, pfd[2];
+	pid_t pid;
+
+	if((buf=malloc(partsize))==NULL)
+		return -1;
+	n=readfull(f,buf,partsize);
+	if(n<partsize)	/* fits one part: plain PUT */
+	{
+		i=request_retry("PUT",key,"",buf,n,&resp);
+		free(resp);
+		free(buf);
+		if(i!=200)
+			return -1;
+		printf("%s: %lu bytes\n",key,n);
+		return 0;
+	}
+	if(request_retry("POST",key,"uploads=","",0,&resp)!=200 ||
+		xml_value(resp,"UploadId",id,sizeof(id))!=0)
+	{
+		fprintf(stderr,"Unable to start upload of %s\n",key);
+		free(resp);
+		free(buf);
+		return -1;
+	}
+	free(resp);
+	uri_encode(id,0,eid);
+	etags=calloc(MAXPARTS,sizeof(*etags));
+	while(etags!=NULL && n>0 && !failed)
+	{
+		if(nparts==MAXPARTS)
+		{
+			fprintf(stderr,"%s needs more than %d parts, use a larger -p\n",key,MAXPARTS);
+			failed=1;
+			break;
+		}
+		if(pipe(pfd)!=0 || (pid=fork())<0)
+		{
+			failed=1;
+			break;
+		}
+		if(pid==0)
+		{
+			close(pfd[0]);
+			put_part(key,id,nparts+1,buf,n,pfd[1]);
+		}
+		close(pfd[1]);
+		job[running].pid=pid;
+		job[running].fd=pfd[0];
+		job[running].no=++nparts;
+		running++;
+		total+=n;
+		/* the child has its own copy; read on while it uploads */
+		n=readfull(f,buf,partsize);
+		while(running==jobs || (running>0 && (n==0 || failed)))
+		{
+			pid=wait(&st);
+			for(i=0;i<running && job[i].pid!=pid;i++)
+				;
+			if(i==running)
+				continue;
+			if(!WIFEXITED(st) || WEXITSTATUS(st)!=0 ||
+				read(job[i].fd,etags[job[i].no-1],sizeof(etags[0]))<=0)
+				failed=1;
+			close(job[i].fd);
+			job[i]=job[--running];
+		}
+		printf("\r%s: %d parts, %lu bytes",key,nparts,total);
+		fflush(stdout);
+	}
+	printf("\n");
+	free(buf);
+	if(etags==NULL || failed)
+	{
+		sprintf(q,"uploadId=%s",eid);
+		request("DELETE",key,q,"",0,&resp);	/* abort, parts are dropped */
+		free(resp);
+		free(etags);
+		return -1;
+	}
+	if((xml=malloc(64+nparts*200))==NULL)
+		return -1;
+	p=xml+sprintf(xml,"<CompleteMultipartUpload>");
+	for(i=0;i<nparts;i++)
+		p+=sprintf(p,"<Part><PartNumber>%d</PartNumber><ETag>%s</ETag></Part>",i+1,etags[i]);
+	strcpy(p,"</CompleteMultipartUpload>");
+	free(etags);
+	sprintf(q,"uploadId=%s",eid);
+	i=request_retry("POST",key,q,xml,strlen(xml),&resp);
+	free(xml);
+	/* an error can come with status 200, in the body */
+	if(i!=200 || resp==NULL || strstr(resp,"<Error>")!=NULL)
+		i=-1;
+	free(resp);
+	return i==200?0:-1;
+}
+
+int main(int argc, char *argv[])
+{
+	char *url=NULL, *name=NULL, *p, *e;
+	char key[sizeof(prefix)+512];
+	const char *base;
+	FILE *f;
+	int i, res=0, nfiles=0;
+
+	for(i=1;i<argc;i++)
+	{
+		if(strncmp(argv[i],"-j=",3)==0)
+			jobs=atoi(argv[i]+3);
+		else if(strncmp(argv[i],"-p=",3)==0)
+			partsize=strtoul(argv[i]+3,NULL,10)<<20;
+		else if(strncmp(argv[i],"-n=",3)==0)
+			name=argv[i]+3;
+		else if(url==NULL && strncmp(argv[i],"http://",7)==0)
+			url=argv[i]+7;
+		else if(url!=NULL && (argv[i][0]!='-' || argv[i][1]==0))
+			nfiles++;
+		else
+		{
+			print_usage();
+			return 2;
+		}
+	}
+	/* S3 parts are 5 MB at least (but the last) */
+	if(url==NULL || nfiles==0 || jobs<1 || jobs>MAXJOBS || partsize<(5UL<<20) ||
+		partsize>(1UL<<30))
+	{
+		print_usage();
+		return 2;
+	}
+	if((akey=getenv("AWS_ACCESS_KEY_ID"))==NULL || (skey=getenv("AWS_SECRET_ACCESS_KEY"))==NULL)
+	{
+		printf("AWS_ACCESS_KEY_ID and AWS_SECRET_ACCESS_KEY must be set\n");
+		return 2;
+	}
+	if((region=getenv("AWS_REGION"))==NULL)
+		region="us-east-1";
+
+	/* host[:port]/bucket/prefix */
+	if((p=strchr(url,'/'))==NULL || p-url>=(int)sizeof(host) || strlen(p)>=sizeof(prefix))
+	{
+		print_usage();
+		return 2;
+	}
+	memcpy(host,url,p-url);
+	host[p-url]=0;
+	strcpy(port,"80");
+	if((e=strchr(host,':'))!=NULL)
+	{
+		*e++=0;
+		if(strlen(e)>=sizeof(port))
+			return 2;
+		strcpy(port,e);
+	}
+	p++;
+	if((e=strchr(p,'/'))==NULL)
+		e=p+strlen(p);
+	if(e==p || e-p>=(int)sizeof(bucket))
+	{
+		print_usage();
+		return 2;
+	}
+	memcpy(bucket,p,e-p);
+	bucket[e-p]=0;
+	strcpy(prefix,*e?e+1:"");
+
+	for(i=1;i<argc;i++)
+	{
+		if(argv[i][0]=='-' && argv[i][1]!=0)
+			continue;
+		if(strncmp(argv[i],"http://",7)==0)
+			continue;
+		if(strcmp(argv[i],"-")==0)
+		{
+			if(name==NULL)
+			{
+				printf("Standard input needs an object name, -n=name\n");
+				res=1;
+				continue;
+			}
+			base=name;
+			f=stdin;
+		}
+		else
+		{
+			base=(base=strrchr(argv[i],'/'))!=NULL?base+1:argv[i];
+			if((f=fopen(argv[i],"rb"))==NULL)
+			{
+				printf("Unable to open %s\n",argv[i]);
+				res=1;
+				continue;
+			}
+		}
+		if(strlen(base)>=512)
+		{
+			if(f!=stdin)
+				fclose(f);
+			res=1;
+			continue;
+		}
+		sprintf(key,"%s%s",prefix,base);
+		if(upload(f,key)!=0)
+		{
+			printf("Upload of %s failed\n",key);
+			res=1;
+		}
+		if(f!=stdin)
+			fclose(f);
+	}
+	return res;
+}
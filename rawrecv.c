@@ -0,0 +1,259 @@
+/* rawrecv - receive a framed rawhdd stream (rawhdd -o=frame).
+ * Rebuilds the image (all-zero tracks become holes where the file system
+ * supports them) and writes the map of what was received to a log in
+ * rawhdd.log format, so the image can be resumed or merged later.
+ * Reads the stream from standard input, e.g. "nc -l 9000 | rawrecv x.img".
+ * Portable C; builds under DOS as well as on the storage host.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef __MSDOS__
+#include <io.h>
+#include <fcntl.h>
+#endif
+#include "frame.h"
+#include "crc32c.h"
+#include "lz.h"
+
+FILE *img=NULL;
+FILE *lf=NULL;
+char *fn;
+unsigned int tracks=0, heads=0, sectors=0;
+unsigned int trackbytes;
+long imgsize=0;		/* current length of image file */
+unsigned char *pbuf;	/* frame payload */
+unsigned char *tbuf;	/* decompressed sectors */
+unsigned char bad[64];	/* unreadable sectors of track pend */
+unsigned long pend=0xffffffffUL;
+
+void print_usage()
+{
+	printf("Usage: rawrecv [-l=logfile] <dst_file>\n");
+	printf("Reads a stream written by rawhdd -o=frame from standard input and writes\n");
+	printf("the image to dst_file. Received tracks are logged to logfile (default\n");
+	printf("rawhdd.log) as rawhdd would, so rawhdd -r can resume from that log.\n");
+}
+
+/* read exactly n bytes; returns 0 at end of stream */
+int get(void *p, unsigned int n)
+{
+	return fread(p,1,n,stdin)==n;
+}
+
+/* geometry frame: open image and start a log session */
+int start(frame *fr)
+{
+	time_t t;
+	tracks=pbuf[0]|(pbuf[1]<<8);
+	heads=pbuf[2]|(pbuf[3]<<8);
+	sectors=pbuf[4]|(pbuf[5]<<8);
+	if(tracks==0 || heads==0 || sectors==0 || sectors>63)
+	{
+		printf("Bad geometry %u,%u,%u\n",tracks,heads,sectors);
+		return -1;
+	}
+	trackbytes=512*sectors;
+	if(img!=NULL)	/* sender was restarted */
+		fclose(img);
+	img=NULL;
+	if(fr->flags&FR_KEEP)	/* resumed copy: fill in existing image */
+		img=fopen(fn,"r+b");
+	if(img==NULL)
+		img=fopen(fn,"w+b");
+	if(img==NULL)
+	{
+		printf("Unable to create %s\n",fn);
+		return -1;
+	}
+	fseek(img,0L,SEEK_END);
+	imgsize=ftell(img);
+	t=time(NULL);
+	fprintf(lf,"\n%s copy started at %s\n",fn,asctime(localtime(&t)));
+	fprintf(lf,"Drive 0 CHS: %u,%u,%u\n",tracks,heads,sectors);
+	if(fr->flags&FR_KEEP)	/* map_import() relies on this line */
+		fprintf(lf,"Resuming from stream\n");
+	printf("Receiving %s: CHS %u,%u,%u%s\n",fn,tracks,heads,sectors,
+		(fr->flags&FR_KEEP)?", resumed":"");
+	pend=0xffffffffUL;
+	return 0;
+}
+
+/* log a track the way rawhdd does */
+void logtrack(unsigned long trk)
+{
+	unsigned int s;
+	unsigned int c=(unsigned int)(trk/heads), h=(unsigned int)(trk%heads);
+	if(trk!=pend)
+	{
+		fprintf(lf,"OK: %u,%u,*\n",c,h);
+		return;
+	}
+	for(s=0;s<sectors;s++)
+		fprintf(lf,"%s: %u,%u,%u\n",bad[s]?"ERR":"OK",c,h,s+1);
+	pend=0xffffffffUL;
+}
+
+/* data, compressed or zero frame */
+int data(frame *fr)
+{
+	long pos=(long)fr->lba*512;
+	unsigned int n=fr->count*512;
+	unsigned char *p=tbuf;
+
+	if(fr->count==0 || fr->count>sectors)
+		return -1;
+	switch(fr->type)
+	{
+		case FR_DATA:
+			if(fr->len!=n)
+				return -1;
+			p=pbuf;
+			break;
+		case FR_LZ:
+			if(lz_unpack(pbuf,fr->len,tbuf,n)!=(long)n)
+				return -1;
+			break;
+		case FR_ZERO:
+			if(pos>=imgsize)	/* leave a hole */
+				goto logit;
+			memset(tbuf,0,n);
+			break;
+	}
+	if(fseek(img,pos,SEEK_SET)!=0 || fwrite(p,n,1,img)!=1)
+	{
+		printf("Error writing %s\n",fn);
+		exit(1);
+	}
+	if(pos+n>imgsize)
+		imgsize=pos+n;
+logit:
+	if(fr->lba%sectors==0 && fr->count==sectors)
+		logtrack(fr->lba/sectors);
+	return 0;
+}
+
+int main(int argc,char *argv[])
+{
+	unsigned char h[FR_HDRLEN];
+	unsigned char c[4];
+	char *logname="rawhdd.log";
+	frame fr;
+	unsigned long skipped=0, nbad=0;
+	unsigned int i;
+	time_t t;
+
+	for(i=1;i<(unsigned int)argc;i++)
+	{
+		if(strncmp(argv[i],"-l=",3)==0)
+			logname=argv[i]+3;
+		else if(argv[i][0]=='-' || fn!=NULL)
+		{
+			print_usage();
+			return 2;
+		}
+		else
+			fn=argv[i];
+	}
+	if(fn==NULL)
+	{
+		print_usage();
+		return 2;
+	}
+#ifdef __MSDOS__
+	setmode(fileno(stdin),O_BINARY);
+#endif
+	pbuf=malloc(0xffffU);
+	tbuf=malloc(63*512);
+	lf=fopen(logname,"at");
+	if(pbuf==NULL || tbuf==NULL || lf==NULL)
+	{
+		printf("Unable to start (memory or %s)\n",logname);
+		return 2;
+	}
+
+	if(!get(h,FR_HDRLEN))
+		goto eos;
+	for(;;)
+	{
+		/* resynchronise on the next "RF" if the stream got damaged */
+		if(fr_parse(h,&fr)!=0)
+		{
+			memmove(h,h+1,FR_HDRLEN-1);
+			skipped++;
+			if(!get(h+FR_HDRLEN-1,1))
+				goto eos;
+			continue;
+		}
+		if(skipped)
+		{
+			printf("Skipped %lu bytes of garbage\n",skipped);
+			skipped=0;
+		}
+		if(!get(pbuf,fr.len) || !get(c,FR_CRCLEN))
+			goto eos;
+		if(fr_crc(h,pbuf)!=get32le(c))
+		{
+			printf("Bad frame at LBA %lu dropped (CRC)\n",fr.lba);
+			nbad++;
+		}
+		else if(fr.type==FR_GEOM)
+		{
+			if(fr.len<6 || start(&fr)!=0)
+				return 1;
+		}
+		else if(img==NULL)
+			printf("Frame before geometry dropped\n");
+		else switch(fr.type)
+		{
+			case FR_ERR:
+				if(pend!=fr.lba/sectors)	/* new track */
+					memset(bad,0,sizeof(bad));
+				pend=fr.lba/sectors;
+				for(i=0;i<fr.count && fr.lba%sectors+i<sectors;i++)
+					bad[(unsigned int)(fr.lba%sectors)+i]=1;
+				break;
+			case FR_DATA:
+			case FR_LZ:
+			case FR_ZERO:
+				if(data(&fr)!=0)
+				{
+					printf("Bad data frame at LBA %lu dropped\n",fr.lba);
+					nbad++;
+				}
+				break;
+			case FR_CKPT:
+				fflush(img);
+				fflush(lf);
+				printf("CH %lu OK\n",fr.lba/sectors/heads-1);
+				break;
+			case FR_END:
+				/* trailing zero tracks were holes, make the size right */
+				if((long)fr.lba*512>imgsize)
+				{
+					fseek(img,(long)fr.lba*512-1,SEEK_SET);
+					fputc(0,img);
+				}
+				fclose(img);
+				t=time(NULL);
+				fprintf(lf,"%s copy finished at %s\n",fn,asctime(localtime(&t)));
+				fclose(lf);
+				printf("Done, %lu bad frames\n",nbad);
+				return nbad?1:0;
+		}
+		if(!get(h,FR_HDRLEN))
+			goto eos;
+	}
+eos:
+	printf("Stream ended before the end frame\n");
+	if(img!=NULL)
+		fclose(img);
+	fprintf(lf,"Stream ended early\n");
+	fclose(lf);
+	return 1;
+}
@@ -0,0 +1,648 @@
+/* rhdest.c - destinations of a copy: where each track that was read goes.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef __MSDOS__
+#include <io.h>
+#include <bios.h>
+#include <dos.h>
+#else
+#include <unistd.h>
+#include <sys/time.h>
+#define O_BINARY	0
+#endif
+#include "rhdest.h"
+#include "frame.h"
+#include "crc32c.h"
+#include "lz.h"
+#include "entropy.h"
+#include "rhmap.h"
+#include "ewf.h"
+#include "qcow.h"
+#include "aes.h"
+#include "sha256.h"
+
+#define ZWIN	16	/* -z=a: tracks between decisions */
+#define ZPROBE	4	/* windows before compression is tried again */
+
+static unsigned int tracks, heads, sectors;
+static unsigned int trackbytes;
+static unsigned char *fbuf=NULL;	/* frame being sent, shared by all streams */
+static unsigned char key[AES_KEYLEN];	/* from the key file, for -o=aes */
+static int haskey=0;
+
+void dst_geometry(unsigned int t, unsigned int h, unsigned int s)
+{
+	tracks=t;
+	heads=h;
+	sectors=s;
+	trackbytes=512*s;
+}
+
+void dst_key(const unsigned char *k)
+{
+	memcpy(key,k,AES_KEYLEN);
+	haskey=1;
+}
+
+/* milliseconds, for rates; wraps (at midnight under DOS) */
+unsigned long dst_clock(void)
+{
+#ifdef __MSDOS__
+	return (unsigned long)biostime(0,0L)*55;	/* 18.2 ticks a second */
+#else
+	struct timeval tv;
+	gettimeofday(&tv,NULL);
+	return (unsigned long)tv.tv_sec*1000+tv.tv_usec/1000;
+#endif
+}
+
+/* token bucket: wait until the bytes already written are paid for.
+ * Holds up to a second's worth, so short stalls are made up */
+static void pace(dest *d)
+{
+	unsigned long now, ms;
+	long full=(long)d->rate*1000;
+
+	for(;;)
+	{
+		now=dst_clock();
+		ms=now-d->tick;
+		if(ms>1000)	/* also first call and clock wrap */
+			ms=1000;
+		d->tick=now;
+		d->tokens+=(long)(d->rate*ms);
+		if(d->tokens>full)
+			d->tokens=full;
+		if(d->tokens>=0)
+			return;
+#ifndef __MSDOS__
+		usleep(10000);
+#endif
+	}
+}
+
+/* -z=a, at the end of each window of ZWIN tracks. Reads and writes take
+ * turns, so compressing pays when it costs less time than writing the
+ * bytes it saves would have; with a slow link or -b that is most data,
+ * with a fast disk or incompressible data none. Compression that did not
+ * pay is tried again after ZPROBE windows, in case the link got slower */
+static void lz_auto(dest *d)
+{
+	unsigned long wms=d->zms>d->zpack?d->zms-d->zpack:0;
+
+	if(d->zon)
+		d->zon=d->zsaved>0 && (d->zpack==0 ||
+			d->zpack*(d->zout/1024+1)<wms*(d->zsaved/1024));
+	else if(++d->zoff>=ZPROBE)
+		d->zon=1;
+	if(d->zon)
+		d->zoff=0;
+	d->zn=0;
+	d->zms=d->zpack=d->zout=d->zsaved=0;
+}
+
+/* set up destination from its command line argument. A stripe set is
+ * given as manifest=volume,volume,... ('=' and ',' can't be part of DOS
+ * file names); spec is split in place */
+int dst_init(dest *d, char *spec, int format, int lz)
+{
+	char *p;
+	memset(d,0,sizeof(dest));
+	d->fn=spec;
+	d->format=format;
+	d->lz=lz;
+	d->zon=1;	/* LZ_AUTO starts out measuring compression */
+	if(format!=FMT_STRIPE)
+		return 0;
+	if((p=strchr(spec,'='))==NULL)
+		return -1;
+	*p++=0;
+	while(p!=NULL && *p)
+	{
+		if(d->nvol==MAXVOL)
+			return -1;
+		d->vol[d->nvol++]=p;
+		if((p=strchr(p,','))!=NULL)
+			*p++=0;
+	}
+	return d->nvol>0?0:-1;
+}
+
+/* send frame; payload (if any) is already at fbuf+FR_HDRLEN */
+static int send_frame(dest *d,int type,int flags,unsigned long lba,unsigned int count,unsigned int len)
+{
+	frame fr;
+	fr.type=type;
+	fr.flags=flags;
+	fr.lba=lba;
+	fr.count=count;
+	fr.len=len;
+	fr_header(fbuf,&fr);
+	put32le(fbuf+FR_HDRLEN+len,fr_crc(fbuf,fbuf+FR_HDRLEN));
+	len+=FR_HDRLEN+FR_CRCLEN;
+	d->out+=len;
+	return write(d->fh,fbuf,len)==len?0:-1;
+}
+
+static int iszero(const char *p,unsigned int n)
+{
+	while(n>0 && *p==0)
+	{
+		p++;
+		n--;
+	}
+	return n==0;
+}
+
+/* send a track as frames: unreadable sectors first, then the data */
+static int frame_track(dest *d,unsigned long trk,char *buf,unsigned char *bad)
+{
+	unsigned long lba=trk*sectors, t;
+	unsigned int i, j, n;
+
+	for(i=0;bad!=NULL && i<sectors;i=j)
+	{
+		for(j=i;j<sectors && bad[j]==bad[i];j++)
+			;
+		if(bad[i] && send_frame(d,FR_ERR,0,lba+i,j-i,0)!=0)
+			return -1;
+	}
+	if(iszero(buf,trackbytes))
+		return send_frame(d,FR_ZERO,0,lba,sectors,0);
+	/* random looking data (encrypted, already compressed) is not packed */
+	if(d->lz>0 || (d->lz==LZ_AUTO && d->zon))
+	{
+		t=dst_clock();
+		n=0;
+		if(entropy(buf,trackbytes)<=ENT_NOPACK)
+			n=lz_pack((unsigned char *)buf,trackbytes,fbuf+FR_HDRLEN,trackbytes-1);
+		d->zpack+=dst_clock()-t;
+		if(n>0)
+		{
+			d->zsaved+=trackbytes-n;
+			return send_frame(d,FR_LZ,0,lba,sectors,n);
+		}
+	}
+	memcpy(fbuf+FR_HDRLEN,buf,trackbytes);
+	return send_frame(d,FR_DATA,0,lba,sectors,trackbytes);
+}
+
+static int open_out(const char *fn, int keep)
+{
+	if(keep)
+		return open(fn,O_CREAT|O_BINARY|O_WRONLY,S_IREAD|S_IWRITE);
+	return open(fn,O_CREAT|O_BINARY|O_TRUNC|O_WRONLY,S_IREAD|S_IWRITE);
+}
+
+/* manifest of a stripe set, read by img_open() */
+static int stripe_manifest(dest *d)
+{
+	FILE *f;
+	int i;
+	if((f=fopen(d->fn,"wt"))==NULL)
+		return -1;
+	fprintf(f,"RAWHDD STRIPE\nCHS %u,%u,%u\nCHUNK %u\n",tracks,heads,sectors,trackbytes);
+	for(i=0;i<d->nvol;i++)
+		fprintf(f,"%s\n",d->vol[i]);
+	return fclose(f);
+}
+
+/* segment s of a segmented image: NAME.000, NAME.001, ... next to the index.
+ * seg_open allows 1000 of them; ext holds any unsigned anyway */
+static int seg_name(dest *d, unsigned int s, char *out)
+{
+	char ext[12];
+	sprintf(ext,"%03u",s);
+	return sidecar(out,NAMELEN,d->fn,ext);
+}
+
+static unsigned long seg_tracks(dest *d, unsigned int s)
+{
+	unsigned long n=(unsigned long)tracks*heads-(unsigned long)s*d->segtrk;
+	return n<d->segtrk?n:d->segtrk;
+}
+
+/* segment size of an existing index, so a resumed copy keeps the layout */
+static void seg_oldsize(dest *d)
+{
+	FILE *f;
+	char line[32];
+	unsigned long n;
+	if((f=fopen(d->fn,"rt"))==NULL)
+		return;
+	while(fgets(line,sizeof(line),f)!=NULL)
+		if(sscanf(line,"SEGMENT %lu",&n)==1 && n>0 && n%trackbytes==0)
+		{
+			d->segsize=n;
+			break;
+		}
+	fclose(f);
+}
+
+/* set up the segments; a new copy creates all of them at full size, which
+ * reserves the space (and fails early if there is not enough of it) */
+static int seg_open(dest *d, int keep)
+{
+	char name[NAMELEN];
+	unsigned int s;
+	int fh;
+	if(keep)
+		seg_oldsize(d);
+	d->segtrk=d->segsize/trackbytes;
+	if(d->segtrk==0)
+		d->segtrk=1;
+	d->segsize=d->segtrk*trackbytes;
+	d->nseg=(unsigned int)(((unsigned long)tracks*heads+d->segtrk-1)/d->segtrk);
+	if(d->nseg>1000)	/* three digit extensions */
+		return -1;
+	d->segcrc=malloc(d->nseg*sizeof(unsigned long));
+	d->segfill=malloc(d->nseg*sizeof(unsigned long));
+	if(d->segcrc==NULL || d->segfill==NULL)
+		return -1;
+	for(s=0;s<d->nseg;s++)
+	{
+		d->segcrc[s]=0;
+		d->segfill[s]=keep?SEG_STALE:0;
+		if(keep)
+			continue;
+		if(seg_name(d,s,name)!=0 || (fh=open_out(name,0))<1)
+			return -1;
+		if(lseek(fh,(long)(seg_tracks(d,s)*trackbytes)-1,SEEK_SET)<0 || write(fh,"",1)!=1)
+		{
+			close(fh);
+			return -1;
+		}
+		close(fh);
+	}
+	d->cur=-1;
+	d->fh=-1;
+	return 0;
+}
+
+static int seg_track(dest *d, unsigned long trk, char *buf)
+{
+	char name[NAMELEN];
+	unsigned int s=(unsigned int)(trk/d->segtrk);
+	unsigned long k=trk%d->segtrk;
+	if((int)s!=d->cur)
+	{
+		if(d->cur>=0)
+			close(d->fh);
+		d->cur=-1;
+		if(seg_name(d,s,name)!=0 || (d->fh=open_out(name,1))<1)
+			return -1;
+		d->cur=(int)s;
+	}
+	/* the CRC of a segment written from its start in order comes for free */
+	if(d->segfill[s]==k)
+	{
+		d->segcrc[s]=crc32c(d->segcrc[s],buf,trackbytes);
+		d->segfill[s]++;
+	}
+	else
+		d->segfill[s]=SEG_STALE;
+	lseek(d->fh,(long)k*trackbytes,SEEK_SET);
+	return write(d->fh,buf,trackbytes)==trackbytes?0:-1;
+}
+
+/* CRC-32C of a segment file; returns -1 if it can't be read */
+static int seg_readcrc(dest *d, unsigned int s, unsigned long *crc)
+{
+	char name[NAMELEN];
+	FILE *f;
+	char *buf=NULL;
+	unsigned long i, n=seg_tracks(d,s);
+	int res=0;
+	if(seg_name(d,s,name)!=0 || (buf=malloc(trackbytes))==NULL || (f=fopen(name,"rb"))==NULL)
+	{
+		free(buf);
+		return -1;
+	}
+	*crc=0;
+	for(i=0;i<n && res==0;i++)
+		if(fread(buf,trackbytes,1,f)==1)
+			*crc=crc32c(*crc,buf,trackbytes);
+		else
+			res=-1;
+	fclose(f);
+	free(buf);
+	return res;
+}
+
+/* index of a segmented image, read by img_open() and rawcrc. Segments
+ * not written in order (resumed copies) are read back for their CRC;
+ * an unfinished copy gets "-" instead */
+static int seg_index(dest *d, int complete)
+{
+	char name[NAMELEN];
+	FILE *f;
+	unsigned int s;
+	unsigned long crc;
+	int res=0;
+	if(d->cur>=0)
+		close(d->fh);
+	if((f=fopen(d->fn,"wt"))==NULL)
+		return -1;
+	fprintf(f,"RAWHDD SEGMENTS\nCHS %u,%u,%u\nSEGMENT %lu\n",tracks,heads,sectors,d->segsize);
+	for(s=0;s<d->nseg;s++)
+	{
+		if(seg_name(d,s,name)!=0)
+		{
+			res=-1;
+			break;
+		}
+		crc=d->segcrc[s];
+		if(d->segfill[s]!=seg_tracks(d,s) && (!complete || seg_readcrc(d,s,&crc)!=0))
+			fprintf(f,"%s %lu -\n",name,seg_tracks(d,s)*trackbytes);
+		else
+			fprintf(f,"%s %lu %08lX\n",name,seg_tracks(d,s)*trackbytes,crc);
+	}
+	if(fclose(f)!=0)
+		res=-1;
+	free(d->segcrc);
+	free(d->segfill);
+	d->segcrc=d->segfill=NULL;
+	return res;
+}
+
+static void put16le(unsigned char *p, unsigned long v)
+{
+	p[0]=(unsigned char)v;
+	p[1]=(unsigned char)(v>>8);
+}
+
+/* the salt need not be secret, only different for every image: two
+ * images with the same key and salt would use the same IVs. The host
+ * has a random device; under DOS the jitter of the timer chip against
+ * the BIOS tick, sampled over a few ticks, stands in for one */
+static void salt(dest *d, unsigned char *out)
+{
+	static unsigned long count=0;	/* images made in this run */
+	sha256_ctx s;
+	unsigned long t;
+#ifdef __MSDOS__
+	unsigned char pit[2];
+	unsigned long tick, spins;
+	int i;
+#else
+	unsigned char r[32];
+	FILE *f;
+#endif
+
+	sha256_init(&s);
+#ifdef __MSDOS__
+	for(i=0;i<8;i++)
+	{
+		tick=biostime(0,0L);
+		for(spins=0;biostime(0,0L)==tick;spins++)
+			;
+		outportb(0x43,0);	/* latch channel 0 */
+		pit[0]=inportb(0x40);
+		pit[1]=inportb(0x40);
+		sha256_update(&s,pit,2);
+		sha256_update(&s,&spins,sizeof(spins));
+	}
+#else
+	if((f=fopen("/dev/urandom","rb"))!=NULL)
+	{
+		if(fread(r,sizeof(r),1,f)==1)
+			sha256_update(&s,r,sizeof(r));
+		fclose(f);
+	}
+#endif
+	t=(unsigned long)time(NULL);
+	sha256_update(&s,&t,sizeof(t));
+	t=dst_clock();
+	sha256_update(&s,&t,sizeof(t));
+	t=++count;
+	sha256_update(&s,&t,sizeof(t));
+	t=((unsigned long)tracks<<16)^((unsigned long)heads<<8)^sectors;
+	sha256_update(&s,&t,sizeof(t));
+	sha256_update(&s,d->fn,strlen(d->fn));
+	sha256_final(&s,out);
+}
+
+/* encrypted image: a fresh one gets a new salt, a kept one must have been
+ * written with the same key and geometry and gets the next session */
+static int aes_open(dest *d, int keep)
+{
+	unsigned char h[AES_HDRLEN], check[8], rnd[32];
+
+	if(!haskey || (d->aes=malloc(sizeof(aes_ctx)))==NULL ||
+		(d->abuf=malloc(AES_IVLEN+trackbytes+AES_TAGLEN))==NULL)
+		return -1;
+	if(keep)
+	{
+		if((d->fh=open(d->fn,O_BINARY|O_RDWR))<1 || read(d->fh,h,AES_HDRLEN)!=AES_HDRLEN ||
+			memcmp(h,AES_MAGIC,16)!=0 || (unsigned int)(h[16]|(h[17]<<8))!=tracks ||
+			(unsigned int)(h[18]|(h[19]<<8))!=heads || (unsigned int)(h[20]|(h[21]<<8))!=sectors)
+			return -1;
+		aes_imagekey(d->aes,key,h+24,check);
+		if(memcmp(check,h+40,8)!=0)
+		{
+			printf("%s was written with another key\n",d->fn);
+			return -1;
+		}
+		d->session=h[48]|(h[49]<<8)|((unsigned long)(h[50]|(h[51]<<8))<<16);
+		d->session++;
+	}
+	else
+	{
+		if((d->fh=open_out(d->fn,0))<1)
+			return -1;
+		memset(h,0,AES_HDRLEN);
+		salt(d,rnd);
+		memcpy(h,AES_MAGIC,16);
+		put16le(h+16,tracks);
+		put16le(h+18,heads);
+		put16le(h+20,sectors);
+		memcpy(h+24,rnd,16);
+		aes_imagekey(d->aes,key,h+24,h+40);
+		d->session=1;
+	}
+	put16le(h+48,d->session);
+	put16le(h+50,d->session>>16);
+	if(lseek(d->fh,0L,SEEK_SET)!=0 || write(d->fh,h,AES_HDRLEN)!=AES_HDRLEN)
+		return -1;
+	return 0;
+}
+
+static int aes_track(dest *d, unsigned long trk, char *buf)
+{
+	unsigned char *p=d->abuf;
+	unsigned int n=AES_IVLEN+trackbytes+AES_TAGLEN;
+
+	put16le(p,d->session);
+	put16le(p+2,d->session>>16);
+	put16le(p+4,trk);
+	put16le(p+6,trk>>16);
+	memset(p+8,0,4);
+	memcpy(p+AES_IVLEN,buf,trackbytes);
+	aes_gcm_encrypt(d->aes,p,p+AES_IVLEN,trackbytes,p+AES_IVLEN+trackbytes);
+	if(lseek(d->fh,AES_HDRLEN+(long)trk*n,SEEK_SET)<0)
+		return -1;
+	return write(d->fh,p,n)==n?0:-1;
+}
+
+/* keep=1 for resumed or updated copies: existing data stays */
+int dst_open(dest *d, int keep)
+{
+	int i;
+	if(d->format==FMT_STRIPE)
+	{
+		for(i=0;i<d->nvol;i++)
+			if((d->vfh[i]=open_out(d->vol[i],keep))<1)
+				return -1;
+		d->fh=d->vfh[0];
+		return stripe_manifest(d);
+	}
+	if(d->format==FMT_SEG)
+		return seg_open(d,keep);
+	if(d->format==FMT_EWF)	/* written strictly in order, can't be resumed */
+	{
+		d->next=0;
+		if(keep || (d->ewf=malloc(sizeof(ewfout)))==NULL)
+			return -1;
+		return ewf_open(d->ewf,d->fn,tracks,heads,sectors,d->segsize);
+	}
+	if(d->format==FMT_QCOW)
+	{
+		if((d->qcow=malloc(sizeof(qcowout)))==NULL)
+			return -1;
+		return qcow_open(d->qcow,d->fn,(unsigned long)tracks*heads*sectors,keep);
+	}
+	if(d->format==FMT_AES)
+		return aes_open(d,keep);
+	if((d->fh=open_out(d->fn,keep))<1)
+		return -1;
+	d->next=0;
+	if(d->format==FMT_FRAME)	/* stream starts with the geometry */
+	{
+		if(keep)	/* a resumed stream goes on after the old one; pipes can't seek */
+			lseek(d->fh,0L,SEEK_END);
+		if(fbuf==NULL && (fbuf=malloc(FR_HDRLEN+trackbytes+FR_CRCLEN))==NULL)
+			return -1;
+		fbuf[FR_HDRLEN]=(unsigned char)tracks;
+		fbuf[FR_HDRLEN+1]=(unsigned char)(tracks>>8);
+		fbuf[FR_HDRLEN+2]=(unsigned char)heads;
+		fbuf[FR_HDRLEN+3]=(unsigned char)(heads>>8);
+		fbuf[FR_HDRLEN+4]=(unsigned char)sectors;
+		fbuf[FR_HDRLEN+5]=(unsigned char)(sectors>>8);
+		if(send_frame(d,FR_GEOM,keep?FR_KEEP:0,0,0,6)!=0)
+			return -1;
+	}
+	return 0;
+}
+
+static int put(dest *d, unsigned long trk, char *buf, unsigned char *bad)
+{
+	int i;
+	switch(d->format)
+	{
+		case FMT_FRAME:
+			if(frame_track(d,trk,buf,bad)!=0)
+				return -1;
+			/* checkpoint after each cylinder */
+			if(trk%heads==heads-1 && send_frame(d,FR_CKPT,0,(trk+1)*sectors,0,0)!=0)
+				return -1;
+			return 0;
+		case FMT_STRIPE:	/* track t is chunk t/nvol of volume t%nvol */
+			i=(int)(trk%d->nvol);
+			lseek(d->vfh[i],(long)(trk/d->nvol)*trackbytes,SEEK_SET);
+			return write(d->vfh[i],buf,trackbytes)==trackbytes?0:-1;
+		case FMT_SEG:
+			return seg_track(d,trk,buf);
+		case FMT_EWF:
+			if(trk!=d->next++)
+				return -1;
+			return ewf_write(d->ewf,buf,sectors,bad);
+		case FMT_QCOW:
+			return qcow_write(d->qcow,trk*sectors,buf,sectors);
+		case FMT_AES:
+			return aes_track(d,trk,buf);
+		default:
+			if(trk!=d->next)	/* tracks were skipped */
+				lseek(d->fh,(long)trk*trackbytes,SEEK_SET);
+			d->next=trk+1;
+			return write(d->fh,buf,trackbytes)==trackbytes?0:-1;
+	}
+}
+
+/* bad[i] is set for unreadable sectors, bad==NULL if all were read */
+int dst_track(dest *d, unsigned long trk, char *buf, unsigned char *bad)
+{
+	unsigned long before=d->out, t=0;
+	int res;
+
+	if(d->lz==LZ_AUTO)
+		t=dst_clock();
+	if(d->rate)
+		pace(d);
+	res=put(d,trk,buf,bad);
+	if(d->format!=FMT_FRAME)	/* frames count themselves */
+		d->out+=trackbytes;
+	d->tokens-=(long)(d->out-before);
+	if(d->lz==LZ_AUTO)
+	{
+		d->zms+=dst_clock()-t;
+		d->zout+=d->out-before;
+		if(++d->zn==ZWIN)
+			lz_auto(d);
+	}
+	return res;
+}
+
+/* complete=1 if the whole copy is done */
+int dst_close(dest *d, int complete)
+{
+	int res=0;
+	int i;
+	if(d->format==FMT_SEG)
+		return d->segcrc!=NULL?seg_index(d,complete):0;
+	if(d->format==FMT_EWF)
+	{
+		if(d->ewf==NULL)
+			return 0;
+		res=ewf_close(d->ewf,complete);
+		free(d->ewf);
+		d->ewf=NULL;
+		return res;
+	}
+	if(d->format==FMT_QCOW)	/* consistent even if the copy was cut short */
+	{
+		if(d->qcow==NULL)
+			return 0;
+		res=qcow_close(d->qcow);
+		free(d->qcow);
+		d->qcow=NULL;
+		return res;
+	}
+	if(d->aes!=NULL)	/* don't leave the key behind in memory */
+	{
+		memset(d->aes,0,sizeof(aes_ctx));
+		free(d->aes);
+		free(d->abuf);
+		d->aes=NULL;
+		d->abuf=NULL;
+	}
+	if(d->fh<1)
+		return 0;
+	if(complete && d->format==FMT_FRAME)
+		res=send_frame(d,FR_END,0,(unsigned long)tracks*heads*sectors,0,0);
+	if(d->format==FMT_STRIPE)
+		for(i=0;i<d->nvol;i++)
+			close(d->vfh[i]);
+	else
+		close(d->fh);
+	d->fh=0;
+	return res;
+}
@@ -0,0 +1,68 @@
+/* rhdest.h - destinations of a copy: where each track that was read goes.
+ * rawhdd can write the same data to several destinations, each in its own
+ * format. Tracks may arrive in any order (resumed or updated copies).
+ */
+
+#ifndef RHDEST_H
+#define RHDEST_H
+
+/* output formats */
+#define FMT_RAW		0	/* plain image */
+#define FMT_FRAME	1	/* framed stream, see frame.h */
+#define FMT_STRIPE	2	/* tracks spread over several files, see rhimg.h */
+#define FMT_SEG		3	/* fixed size segment files plus index, see rhimg.h */
+#define FMT_EWF		4	/* EnCase E01 segment files, see ewf.h */
+#define FMT_QCOW	5	/* qcow2 image, see qcow.h */
+#define FMT_AES		6	/* AES-GCM encrypted tracks, see aes.h */
+
+#define MAXDST		4
+#define MAXVOL		8	/* files of a stripe set */
+
+typedef struct dest
+{
+	char		*fn;
+	int		format;		/* FMT_... */
+	int		lz;		/* compress, where the format can; LZ_AUTO */
+	int		fh;
+	unsigned long	next;		/* track at current file position */
+	int		nvol;		/* stripe set: volume files */
+	char		*vol[MAXVOL];
+	int		vfh[MAXVOL];
+	unsigned long	segsize;	/* segments, E01: bytes per segment file */
+	unsigned long	segtrk;		/* tracks per segment */
+	unsigned int	nseg;
+	int		cur;		/* segment open in fh, -1 if none */
+	unsigned long	*segcrc;	/* running CRC-32C of each segment */
+	unsigned long	*segfill;	/* tracks in segcrc, SEG_STALE if not in order */
+	struct ewfout	*ewf;		/* E01 writer */
+	struct qcowout	*qcow;		/* qcow2 writer */
+	struct aes_ctx	*aes;		/* key of an encrypted image */
+	unsigned char	*abuf;		/* record being written */
+	unsigned long	session;	/* IVs of this copy */
+	unsigned long	rate;		/* write limit, KB (1000 bytes) a second; 0: none */
+	long		tokens;		/* bytes that may be written now */
+	unsigned long	tick;		/* when tokens were last added, ms */
+	unsigned long	out;		/* bytes written */
+	int		zon;		/* LZ_AUTO: compressing now */
+	unsigned int	zn;		/* tracks in this window */
+	unsigned int	zoff;		/* windows since compression was turned off */
+	unsigned long	zms;		/* window: ms spent in dst_track */
+	unsigned long	zpack;		/* of which compressing */
+	unsigned long	zout;		/* bytes written */
+	unsigned long	zsaved;		/* bytes compression left out */
+} dest;
+
+/* -z=a: compress frames only while it makes the copy faster */
+#define LZ_AUTO		-1
+
+#define SEG_STALE	0xffffffffUL	/* segment CRC must be read back */
+
+int dst_init(dest *d, char *spec, int format, int lz);
+void dst_geometry(unsigned int tracks, unsigned int heads, unsigned int sectors);
+void dst_key(const unsigned char *key);
+unsigned long dst_clock(void);
+int dst_open(dest *d, int keep);
+int dst_track(dest *d, unsigned long trk, char *buf, unsigned char *bad);
+int dst_close(dest *d, int complete);
+
+#endif
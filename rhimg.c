@@ -0,0 +1,781 @@
+/* rhimg.c - read access to the images rawhdd writes, by LBA.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rhimg.h"
+#include "rhmap.h"
+#include "frame.h"
+#include "crc32c.h"
+#include "lz.h"
+#include "inflate.h"
+#include "aes.h"
+
+#define IDXMAX		8192	/* frame index entries */
+#define RESENTMAX	4096	/* frame: tracks sent again that are listed */
+
+static unsigned char key[AES_KEYLEN];	/* for encrypted images */
+static int haskey=0;
+
+/* read n bytes at pos; what lies beyond the end of the file reads as
+ * zeros (tracks never written, e.g. all-zero ones received by rawrecv) */
+static int readat(FILE *f, long pos, char *buf, unsigned int n)
+{
+	unsigned int got=0;
+	if(fseek(f,pos,SEEK_SET)==0)
+		got=fread(buf,1,n,f);
+	if(got<n)
+	{
+		if(ferror(f))
+			return -1;
+		memset(buf+got,0,n-got);
+	}
+	return 0;
+}
+
+static int iszero(const unsigned char *p, unsigned int n)
+{
+	while(n>0 && *p==0)
+	{
+		p++;
+		n--;
+	}
+	return n==0;
+}
+
+static int open_stripe(rhimg *im, FILE *mf)
+{
+	char line[128];
+	unsigned int c, h, s;
+	char *p;
+
+	if(fgets(line,sizeof(line),mf)==NULL || sscanf(line,"CHS %u,%u,%u",&c,&h,&s)!=3 ||
+		fgets(line,sizeof(line),mf)==NULL || sscanf(line,"CHUNK %u",&im->chunk)!=1 ||
+		im->chunk==0 || im->chunk%512!=0)
+		return -1;
+	im->sectors=(unsigned long)c*h*s;
+	im->cyls=c;
+	im->heads=h;
+	im->spt=s;
+	while(fgets(line,sizeof(line),mf)!=NULL)
+	{
+		if((p=strpbrk(line,"\r\n"))!=NULL)
+			*p=0;
+		if(line[0]==0)
+			continue;
+		if(im->nf==IMG_MAXF || (im->f[im->nf]=fopen(line,"rb"))==NULL)
+		{
+			printf("Unable to open stripe volume %s\n",line);
+			return -1;
+		}
+		im->nf++;
+	}
+	return im->nf>0?0:-1;
+}
+
+static int open_seg(rhimg *im, FILE *mf, const char *fn)
+{
+	char line[128];
+	unsigned int c, h, s;
+
+	if(fgets(line,sizeof(line),mf)==NULL || sscanf(line,"CHS %u,%u,%u",&c,&h,&s)!=3 ||
+		fgets(line,sizeof(line),mf)==NULL || sscanf(line,"SEGMENT %lu",&im->segsize)!=1 ||
+		im->segsize==0 || im->segsize%512!=0 || strlen(fn)>=sizeof(im->index))
+		return -1;
+	im->sectors=(unsigned long)c*h*s;
+	im->cyls=c;
+	im->heads=h;
+	im->spt=s;
+	strcpy(im->index,fn);
+	im->cur=-1;
+	return 0;
+}
+
+/* file n of a segmented or E01 image, opened in place of the previous one */
+static FILE *part(rhimg *im, unsigned long n)
+{
+	char name[NAMELEN], ext[8];
+	if((long)n!=im->cur)
+	{
+		if(im->nf)
+			fclose(im->f[0]);
+		im->nf=0;
+		im->cur=-1;
+		sprintf(ext,im->type==IMG_EWF?"E%02lu":"%03lu",n);
+		if(sidecar(name,sizeof(name),im->index,ext)!=0 || (im->f[0]=fopen(name,"rb"))==NULL)
+			return NULL;
+		im->nf=1;
+		im->cur=(int)n;
+	}
+	return im->f[0];
+}
+
+static int read_seg(rhimg *im, unsigned long seg, long pos, char *buf, unsigned int n)
+{
+	FILE *f;
+	if((f=part(im,seg))==NULL)
+	{
+		printf("Unable to open segment %lu of %s\n",seg,im->index);
+		return -1;
+	}
+	return readat(f,pos,buf,n);
+}
+
+static unsigned long get32be(const unsigned char *p)
+{
+	return ((unsigned long)p[0]<<24)|((unsigned long)p[1]<<16)|((unsigned long)p[2]<<8)|p[3];
+}
+
+/* 64 bit value from its halves; -1 if it doesn't fit an unsigned long */
+static int get64(unsigned long hi, unsigned long lo, unsigned long *v)
+{
+	if(sizeof(unsigned long)<8)
+	{
+		*v=lo;
+		return hi?-1:0;
+	}
+	*v=(hi<<16<<16)|lo;
+	return 0;
+}
+
+#define get64be(p,v)	get64(get32be(p),get32be((p)+4),v)
+#define get64le(p,v)	get64(get32le((p)+4),get32le(p),v)
+
+/* buffers of a chunked format; raw holds a chunk as stored */
+static int chunk_bufs(rhimg *im, unsigned int raw)
+{
+	int i;
+	if((unsigned long)im->csect*512!=(unsigned int)(im->csect*512) ||
+		(im->raw=malloc(raw))==NULL)
+		return -1;
+	im->rawlen=raw;
+	for(i=0;i<IMG_CACHE;i++)
+		if((im->cbuf[i]=malloc(im->csect*512))==NULL)
+			return -1;
+	return 0;
+}
+
+/* note a track sent again at pos; -1 if the list is full */
+static int resent_add(rhimg *im, unsigned long trk, long pos)
+{
+	unsigned long *r;
+	if(im->nresent%256==0)
+	{
+		if(im->nresent>=RESENTMAX ||
+			(r=realloc(im->resent,(im->nresent+256)*2*sizeof(unsigned long)))==NULL)
+			return -1;
+		im->resent=r;
+	}
+	im->resent[2*im->nresent]=trk;
+	im->resent[2*im->nresent+1]=(unsigned long)pos;
+	im->nresent++;
+	return 0;
+}
+
+static int cmp_resent(const void *a, const void *b)
+{
+	const unsigned long *x=a, *y=b;
+	if(x[0]!=y[0])
+		return x[0]<y[0]?-1:1;
+	return x[1]<y[1]?-1:x[1]>y[1];
+}
+
+/* frame file: geometry frame first, then an index of where tracks are.
+ * Resumed and updated copies append to the file (after its end frame,
+ * if it has one), so a track may come more than once and the last frame
+ * of it counts: tracks seen again are listed with their last position */
+static int open_frame(rhimg *im, FILE *f)
+{
+	unsigned char h[FR_HDRLEN];
+	unsigned char *seen=NULL;
+	frame fr;
+	unsigned long trk, tracks, prev=0;
+	unsigned int i, n;
+	long pos;
+	int first=1;
+
+	fseek(f,0L,SEEK_SET);
+	if(fread(h,FR_HDRLEN,1,f)!=1 || fr_parse(h,&fr)!=0 || fr.type!=FR_GEOM || fr.len<6 ||
+		fread(h,6,1,f)!=1)
+		return -1;
+	tracks=(unsigned long)(h[0]|(h[1]<<8))*(h[2]|(h[3]<<8));
+	im->csect=h[4]|(h[5]<<8);
+	if(tracks==0 || im->csect==0 || im->csect>63)
+		return -1;
+	im->sectors=tracks*im->csect;
+	im->cyls=h[0]|(h[1]<<8);
+	im->heads=h[2]|(h[3]<<8);
+	im->spt=im->csect;
+	im->istep=(unsigned int)((tracks+IDXMAX-1)/IDXMAX);
+	im->nidx=(unsigned int)((tracks+im->istep-1)/im->istep);
+	if((im->idx=calloc(im->nidx,sizeof(unsigned long)))==NULL ||
+		chunk_bufs(im,im->csect*512)!=0)
+		return -1;
+	/* one bit per track, as in the region map */
+	if((tracks+7)/8>0xfff0UL || (seen=calloc((unsigned int)((tracks+7)/8),1))==NULL)
+		im->lastscan=1;
+	im->inorder=1;
+	pos=FR_HDRLEN+fr.len+FR_CRCLEN;
+	while(fseek(f,pos,SEEK_SET)==0 && fread(h,FR_HDRLEN,1,f)==1 && fr_parse(h,&fr)==0)
+	{
+		if((fr.type==FR_DATA || fr.type==FR_LZ || fr.type==FR_ZERO) && fr.lba%im->csect==0)
+		{
+			trk=fr.lba/im->csect;
+			if(trk>=tracks)
+				break;
+			if(im->idx[(unsigned int)(trk/im->istep)]==0)
+				im->idx[(unsigned int)(trk/im->istep)]=pos;
+			if(!first && trk<=prev)
+				im->inorder=0;
+			prev=trk;
+			first=0;
+			if(seen!=NULL && !(seen[(unsigned int)(trk>>3)]&1<<(int)(trk&7)))
+				seen[(unsigned int)(trk>>3)]|=1<<(int)(trk&7);
+			else if(seen!=NULL && resent_add(im,trk,pos)!=0)
+			{
+				im->lastscan=1;	/* too many: each read looks through the file */
+				free(seen);
+				seen=NULL;
+			}
+		}
+		pos+=FR_HDRLEN+fr.len+FR_CRCLEN;
+	}
+	free(seen);
+	if(im->nresent>0)	/* by track, the last frame of each at the end */
+	{
+		qsort(im->resent,im->nresent,2*sizeof(unsigned long),cmp_resent);
+		for(i=n=0;i<im->nresent;i++)
+		{
+			if(n>0 && im->resent[2*n-2]==im->resent[2*i])
+				n--;
+			im->resent[2*n]=im->resent[2*i];
+			im->resent[2*n+1]=im->resent[2*i+1];
+			n++;
+		}
+		im->nresent=n;
+	}
+	return 0;
+}
+
+/* position of the frame of track trk from pos on (the last one in the
+ * file if last is set), 0 if there is none */
+static long find_frame(rhimg *im, unsigned long trk, long pos, int last)
+{
+	FILE *f=im->f[0];
+	unsigned char h[FR_HDRLEN];
+	unsigned long t;
+	long at, found=0;
+	frame fr;
+
+	while(fseek(f,pos,SEEK_SET)==0 && fread(h,FR_HDRLEN,1,f)==1 && fr_parse(h,&fr)==0)
+	{
+		at=pos;
+		pos+=FR_HDRLEN+fr.len+FR_CRCLEN;
+		if((fr.type!=FR_DATA && fr.type!=FR_LZ && fr.type!=FR_ZERO) || fr.lba%im->csect!=0)
+			continue;
+		t=fr.lba/im->csect;
+		if(im->inorder && t>trk)
+			break;
+		if(t!=trk)
+			continue;
+		found=at;
+		if(!last)
+			break;
+	}
+	return found;
+}
+
+/* last position of a track that was sent more than once, 0 if it wasn't */
+static long find_resent(rhimg *im, unsigned long trk)
+{
+	unsigned int lo=0, hi=im->nresent, m;
+	while(lo<hi)
+	{
+		m=(lo+hi)/2;
+		if(im->resent[2*m]==trk)
+			return (long)im->resent[2*m+1];
+		if(im->resent[2*m]<trk)
+			lo=m+1;
+		else
+			hi=m;
+	}
+	return 0;
+}
+
+static int read_frame(rhimg *im, long pos, unsigned char *buf)
+{
+	FILE *f=im->f[0];
+	unsigned char h[FR_HDRLEN], c[4];
+	unsigned int n=im->csect*512;
+	unsigned char *p;
+	frame fr;
+
+	if(fseek(f,pos,SEEK_SET)!=0 || fread(h,FR_HDRLEN,1,f)!=1 || fr_parse(h,&fr)!=0 ||
+		fr.len>im->rawlen)
+		return -1;
+	p=fr.type==FR_DATA?buf:im->raw;
+	if(fread(p,1,fr.len,f)!=fr.len || fread(c,4,1,f)!=1 || fr_crc(h,p)!=get32le(c))
+		return -1;
+	if(fr.type==FR_ZERO)
+		memset(buf,0,n);
+	else if(fr.type==FR_LZ && lz_unpack(im->raw,fr.len,buf,n)!=(long)n)
+		return -1;
+	else if(fr.type==FR_DATA && fr.len!=n)
+		return -1;
+	return 0;
+}
+
+static int fetch_frame(rhimg *im, unsigned long trk, unsigned char *buf)
+{
+	long pos=0;
+	if(im->lastscan)
+		pos=find_frame(im,trk,0L,1);
+	else
+	{
+		pos=find_resent(im,trk);
+		if(pos==0 && im->idx[(unsigned int)(trk/im->istep)]!=0)
+			pos=find_frame(im,trk,im->idx[(unsigned int)(trk/im->istep)],0);
+		if(pos==0 && !im->inorder)	/* could be anywhere */
+			pos=find_frame(im,trk,0L,0);
+	}
+	if(pos==0)			/* never sent */
+	{
+		memset(buf,0,im->csect*512);
+		return 0;
+	}
+	return read_frame(im,pos,buf);
+}
+
+/* E01: walk the sections of all segments, keeping the chunk tables */
+static int open_ewf(rhimg *im, const char *fn)
+{
+	unsigned char d[76];
+	unsigned long seg, chunks=0, next;
+	long off;
+	FILE *f;
+	imgtab *t;
+
+	if(strlen(fn)>=sizeof(im->index))
+		return -1;
+	strcpy(im->index,fn);
+	im->cur=-1;
+	for(seg=1;seg<100 && (f=part(im,seg))!=NULL;seg++)
+	{
+		for(off=13;;off=(long)next)
+		{
+			if(readat(f,off,(char *)d,76)!=0 || get64le(d+16,&next)!=0)
+				return -1;
+			if(strcmp((char *)d,"next")==0 || strcmp((char *)d,"done")==0)
+				break;
+			if(strcmp((char *)d,"volume")==0 || strcmp((char *)d,"disk")==0)
+			{
+				if(readat(f,off+76,(char *)d,36)!=0 || get32le(d+12)!=512)
+					return -1;
+				im->csect=(unsigned int)get32le(d+8);
+				im->sectors=get32le(d+16);
+				im->cyls=(unsigned int)get32le(d+24);
+				im->heads=(unsigned int)get32le(d+28);
+				im->spt=(unsigned int)get32le(d+32);
+			}
+			else if(strcmp((char *)d,"table")==0)
+			{
+				if(im->ntab%16==0)
+				{
+					t=realloc(im->tab,(im->ntab+16)*sizeof(imgtab));
+					if(t==NULL)
+						return -1;
+					im->tab=t;
+				}
+				t=&im->tab[im->ntab++];
+				if(readat(f,off+76,(char *)d,24)!=0)
+					return -1;
+				t->seg=(unsigned int)seg;
+				t->entries=off+76+24;
+				t->n=(unsigned int)get32le(d);
+				t->base=(long)get32le(d+8);
+				t->end=off;
+				t->first=chunks;
+				chunks+=t->n;
+			}
+			if((long)next<=off)
+				return -1;
+		}
+	}
+	if(seg==1 || im->csect==0 || im->sectors==0 || chunks*im->csect<im->sectors)
+		return -1;
+	return chunk_bufs(im,im->csect*512+64);
+}
+
+static int fetch_ewf(rhimg *im, unsigned long c, unsigned char *buf)
+{
+	unsigned char e[8];
+	unsigned int i, n=im->csect*512, want=n;
+	unsigned long v, end;
+	long off;
+	imgtab *t;
+	FILE *f;
+
+	for(i=0;i<im->ntab && c>=im->tab[i].first+im->tab[i].n;i++)
+		;
+	if(i==im->ntab)
+		return -1;
+	t=&im->tab[i];
+	if(im->sectors-c*im->csect<im->csect)	/* last chunk is shorter */
+		want=(unsigned int)(im->sectors-c*im->csect)*512;
+	if((f=part(im,t->seg))==NULL ||
+		readat(f,t->entries+(long)(c-t->first)*4,(char *)e,8)!=0)
+		return -1;
+	v=get32le(e);
+	off=t->base+(long)(v&0x7fffffffUL);
+	end=c-t->first+1<t->n?t->base+(get32le(e+4)&0x7fffffffUL):(unsigned long)t->end;
+	if(end<=(unsigned long)off || end-off>im->rawlen)
+		return -1;
+	if(v&0x80000000UL)
+	{
+		if(readat(f,off,(char *)im->raw,(unsigned int)(end-off))!=0 ||
+			inflate_zlib(im->raw,(unsigned int)(end-off),buf,n)!=(long)want)
+			return -1;
+	}
+	else if(readat(f,off,(char *)buf,want)!=0)
+		return -1;
+	memset(buf+want,0,n-want);
+	return 0;
+}
+
+static int open_qcow(rhimg *im, FILE *f)
+{
+	unsigned char h[80];
+	unsigned long v, size, l1off;
+	unsigned int i, ver;
+
+	if(readat(f,0L,(char *)h,80)!=0)
+		return -1;
+	ver=(unsigned int)get32be(h+4);
+	im->cbits=(int)get32be(h+20);
+	/* no backing file, no encryption; version 3 features beyond "dirty"
+	 * change the layout */
+	if((ver!=2 && ver!=3) || get32be(h+8)!=0 || get32be(h+12)!=0 ||
+		im->cbits<9 || im->cbits>21 || get32be(h+32)!=0 ||
+		(ver==3 && (get32be(h+72)!=0 || (get32be(h+76)&~1UL)!=0)))
+		return -1;
+	if(get64be(h+24,&size)!=0)	/* 4 GB at most with 32 bit longs */
+		return -1;
+	im->sectors=size/512;
+	im->csect=1U<<(im->cbits-9);
+	im->nidx=(unsigned int)get32be(h+36);
+	if(get64be(h+40,&l1off)!=0 || (im->idx=calloc(im->nidx+1,sizeof(unsigned long)))==NULL)
+		return -1;
+	for(i=0;i<im->nidx;i++)
+	{
+		if(readat(f,(long)(l1off+8UL*i),(char *)h,8)!=0)
+			return -1;
+		h[0]=0;		/* flags */
+		if(get64be(h,&v)!=0)
+			return -1;
+		im->idx[i]=v&~0x1ffUL;
+	}
+	return chunk_bufs(im,im->csect*512+512);
+}
+
+static int fetch_qcow(rhimg *im, unsigned long c, unsigned char *buf)
+{
+	unsigned char e[8];
+	unsigned int n=im->csect*512, l1i=(unsigned int)(c>>(im->cbits-3));
+	unsigned long hi, lo, off, sect;
+	int x;
+
+	memset(buf,0,n);
+	if(l1i>=im->nidx || im->idx[l1i]==0)
+		return 0;
+	if(readat(im->f[0],(long)(im->idx[l1i]+(c&((1UL<<(im->cbits-3))-1))*8),(char *)e,8)!=0)
+		return -1;
+	hi=get32be(e);
+	lo=get32be(e+4);
+	if(hi&0x40000000UL)	/* compressed: offset and size in sectors */
+	{
+		x=62-(im->cbits-8)-32;
+		sect=((hi>>x)&((1UL<<(im->cbits-8))-1))+1;
+		if(get64(hi&((1UL<<x)-1),lo,&off)!=0)
+			return -1;
+		sect=sect*512-(off&511);
+		if(sect>im->rawlen)
+			sect=im->rawlen;
+		if(readat(im->f[0],(long)off,(char *)im->raw,(unsigned int)sect)!=0 ||
+			inflate_raw(im->raw,(unsigned int)sect,buf,n)!=(long)n)
+			return -1;
+		return 0;
+	}
+	if(lo&1)		/* version 3: reads as zeros */
+		return 0;
+	if(get64(hi&0x00ffffffUL,lo&~0x1ffUL,&off)!=0)
+		return -1;
+	if(off==0)
+		return 0;
+	return readat(im->f[0],(long)off,(char *)buf,n);
+}
+
+/* encrypted image: header, then a record per track (see aes.h) */
+static int open_aes(rhimg *im, FILE *f, const char *fn)
+{
+	unsigned char h[AES_HDRLEN], check[8];
+
+	if(readat(f,0L,(char *)h,AES_HDRLEN)!=0)
+		return -1;
+	im->cyls=h[16]|(h[17]<<8);
+	im->heads=h[18]|(h[19]<<8);
+	im->spt=h[20]|(h[21]<<8);
+	im->csect=im->spt;
+	im->sectors=(unsigned long)im->cyls*im->heads*im->spt;
+	if(im->spt==0 || im->spt>63)
+		return -1;
+	if(!haskey)
+	{
+		printf("%s is encrypted, a key file is needed\n",fn);
+		return -1;
+	}
+	if((im->aes=malloc(sizeof(aes_ctx)))==NULL)
+		return -1;
+	aes_imagekey(im->aes,key,h+24,check);
+	if(memcmp(check,h+40,8)!=0)
+	{
+		printf("Wrong key for %s\n",fn);
+		return -1;
+	}
+	im->session=get32le(h+48);
+	return chunk_bufs(im,AES_IVLEN+im->csect*512+AES_TAGLEN);
+}
+
+static int fetch_aes(rhimg *im, unsigned long trk, unsigned char *buf)
+{
+	unsigned int n=im->csect*512;
+	unsigned char *r=im->raw;
+
+	if(readat(im->f[0],AES_HDRLEN+(long)trk*im->rawlen,(char *)r,im->rawlen)!=0)
+		return -1;
+	if(iszero(r,im->rawlen))	/* never written */
+	{
+		memset(buf,0,n);
+		return 0;
+	}
+	/* a record moved to another place would decrypt fine otherwise; one
+	 * from a later session than the header names was not written by it */
+	if(get32le(r)==0 || get32le(r)>im->session || get32le(r+4)!=trk ||
+		get32le(r+8)!=0 || aes_gcm_decrypt(im->aes,r,r+AES_IVLEN,n,r+AES_IVLEN+n)!=0)
+	{
+		printf("Track %lu fails authentication\n",trk);
+		return -1;
+	}
+	memcpy(buf,r+AES_IVLEN,n);
+	return 0;
+}
+
+/* chunk c, decompressed, from the cache */
+static unsigned char *get_chunk(rhimg *im, unsigned long c)
+{
+	int i, v=0, res;
+	for(i=0;i<IMG_CACHE;i++)
+	{
+		if(im->cid[i]==c+1)
+		{
+			im->cuse[i]=++im->clock;
+			return im->cbuf[i];
+		}
+		if(im->cuse[i]<im->cuse[v])
+			v=i;
+	}
+	im->cid[v]=0;
+	switch(im->type)
+	{
+		case IMG_FRAME: res=fetch_frame(im,c,im->cbuf[v]); break;
+		case IMG_EWF: res=fetch_ewf(im,c,im->cbuf[v]); break;
+		case IMG_AES: res=fetch_aes(im,c,im->cbuf[v]); break;
+		default: res=fetch_qcow(im,c,im->cbuf[v]); break;
+	}
+	if(res!=0)
+		return NULL;
+	im->cid[v]=c+1;
+	im->cuse[v]=++im->clock;
+	return im->cbuf[v];
+}
+
+/* key (from aes_keyfile()) for encrypted images opened afterwards */
+void img_key(const unsigned char *k)
+{
+	memcpy(key,k,AES_KEYLEN);
+	haskey=1;
+}
+
+/* open an image of any kind rawhdd writes; returns 0 on success */
+int img_open(rhimg *im, const char *fn)
+{
+	FILE *f;
+	char line[32];
+	int res;
+
+	memset(im,0,sizeof(rhimg));
+	if((f=fopen(fn,"rb"))==NULL)
+		return -1;
+	if(fgets(line,sizeof(line),f)!=NULL && strncmp(line,"RAWHDD STRIPE",13)==0)
+	{
+		im->type=IMG_STRIPE;
+		if(open_stripe(im,f)!=0)
+		{
+			fclose(f);
+			img_close(im);
+			return -1;
+		}
+		fclose(f);
+		return 0;
+	}
+	if(strncmp(line,"RAWHDD AES-GCM",14)==0)
+	{
+		im->type=IMG_AES;
+		im->f[0]=f;
+		im->nf=1;
+		if(open_aes(im,f,fn)!=0)
+		{
+			img_close(im);
+			return -1;
+		}
+		return 0;
+	}
+	if(strncmp(line,"RAWHDD SEGMENTS",15)==0)
+	{
+		im->type=IMG_SEG;
+		res=open_seg(im,f,fn);
+		fclose(f);
+		return res;
+	}
+	fseek(f,0L,SEEK_SET);
+	if(fread(line,8,1,f)==1)
+	{
+		if(memcmp(line,"EVF\011\015\012\377\000",8)==0)
+		{
+			fclose(f);
+			im->type=IMG_EWF;
+			res=open_ewf(im,fn);
+		}
+		else if(memcmp(line,"QFI\373",4)==0)
+		{
+			im->type=IMG_QCOW;
+			im->f[0]=f;
+			im->nf=1;
+			res=open_qcow(im,f);
+		}
+		else if(line[0]=='R' && line[1]=='F' && line[2]==FR_GEOM)
+		{
+			im->type=IMG_FRAME;
+			im->f[0]=f;
+			im->nf=1;
+			res=open_frame(im,f);
+		}
+		else
+			res=1;
+		if(res<=0)
+		{
+			if(res<0)
+				img_close(im);
+			return res;
+		}
+	}
+	im->type=IMG_RAW;
+	fseek(f,0L,SEEK_END);
+	im->sectors=(unsigned long)ftell(f)/512;
+	im->f[0]=f;
+	im->nf=1;
+	return 0;
+}
+
+/* read count sectors starting at lba (pread style); returns 0 on success */
+int img_read(rhimg *im, unsigned long lba, unsigned int count, void *buf)
+{
+	char *p=buf;
+	unsigned char *q;
+	unsigned long chunk, off;
+	unsigned int in, n;
+
+	if(lba+count>im->sectors)
+		return -1;
+	if(im->type==IMG_RAW)
+		return readat(im->f[0],(long)lba*512,p,count*512);
+	if(im->type>=IMG_FRAME)
+	{
+		while(count>0)
+		{
+			chunk=lba/im->csect;
+			in=(unsigned int)(lba%im->csect);
+			n=im->csect-in;
+			if(n>count)
+				n=count;
+			if((q=get_chunk(im,chunk))==NULL)
+				return -1;
+			memcpy(p,q+in*512,n*512);
+			p+=n*512;
+			lba+=n;
+			count-=n;
+		}
+		return 0;
+	}
+	if(im->type==IMG_SEG)
+	{
+		while(count>0)
+		{
+			chunk=lba/(im->segsize/512);
+			off=lba%(im->segsize/512);	/* sector within segment */
+			n=count;
+			if(off+n>im->segsize/512)
+				n=(unsigned int)(im->segsize/512-off);
+			if(read_seg(im,chunk,(long)off*512,p,n*512)!=0)
+				return -1;
+			p+=n*512;
+			lba+=n;
+			count-=n;
+		}
+		return 0;
+	}
+	while(count>0)
+	{
+		chunk=lba/(im->chunk/512);
+		in=(unsigned int)(lba%(im->chunk/512));	/* sector within chunk */
+		n=im->chunk/512-in;
+		if(n>count)
+			n=count;
+		if(readat(im->f[(int)(chunk%im->nf)],(long)(chunk/im->nf)*im->chunk+in*512L,p,n*512)!=0)
+			return -1;
+		p+=n*512;
+		lba+=n;
+		count-=n;
+	}
+	return 0;
+}
+
+void img_close(rhimg *im)
+{
+	int i;
+	for(i=0;i<im->nf;i++)
+		fclose(im->f[i]);
+	im->nf=0;
+	for(i=0;i<IMG_CACHE;i++)
+	{
+		free(im->cbuf[i]);
+		im->cbuf[i]=NULL;
+		im->cid[i]=0;
+	}
+	free(im->idx);
+	free(im->resent);
+	free(im->tab);
+	free(im->raw);
+	if(im->aes!=NULL)
+		memset(im->aes,0,sizeof(aes_ctx));
+	free(im->aes);
+	im->aes=NULL;
+	im->idx=NULL;
+	im->resent=NULL;
+	im->nresent=0;
+	im->tab=NULL;
+	im->raw=NULL;
+}
@@ -0,0 +1,91 @@
+/* rhimg.h - read access to the images rawhdd writes, by LBA.
+ * Hides how an image is stored (plain file, stripe set, segments, framed
+ * stream, E01, qcow2) from the tools that read it. Formats that store
+ * chunks (frames, E01 and qcow2 clusters) are read a chunk at a time
+ * through a small LRU cache of decompressed chunks. A handle keeps file
+ * positions and the cache, so each reader opens its own.
+ *
+ * Stripe set manifest (text):
+ *	RAWHDD STRIPE
+ *	CHS c,h,s
+ *	CHUNK <bytes>
+ *	<volume file>		one line per volume
+ * Chunk n of the image is chunk n/volumes of volume n%volumes.
+ *
+ * Segment index (text):
+ *	RAWHDD SEGMENTS
+ *	CHS c,h,s
+ *	SEGMENT <bytes>
+ *	<segment file> <bytes> <CRC-32C in hex, "-" if unknown>	one per segment
+ * Segment n is the index name with extension .000, .001, ...; each holds
+ * SEGMENT bytes of the image (the last one may be shorter).
+ */
+
+#ifndef RHIMG_H
+#define RHIMG_H
+
+#include <stdio.h>
+
+#define IMG_RAW		0
+#define IMG_STRIPE	1
+#define IMG_SEG		2
+#define IMG_FRAME	3	/* file written by rawhdd -o=frame */
+#define IMG_EWF		4
+#define IMG_QCOW	5
+#define IMG_AES		6	/* needs the key, see img_key() */
+
+#define IMG_MAXF	8
+#ifndef IMG_CACHE
+#define IMG_CACHE	4	/* decompressed chunks kept; hosts may build with more */
+#endif
+
+/* chunk table of an E01 image */
+typedef struct imgtab
+{
+	unsigned int	seg;		/* segment file */
+	long		entries;	/* offset of the entries in it */
+	long		base;		/* chunk offsets are relative to this */
+	long		end;		/* end of the last chunk */
+	unsigned long	first;		/* first chunk */
+	unsigned int	n;
+} imgtab;
+
+typedef struct rhimg
+{
+	int		type;		/* IMG_... */
+	unsigned long	sectors;	/* size in 512 byte sectors */
+	unsigned int	cyls, heads, spt;	/* geometry, 0 if not recorded */
+	unsigned int	chunk;		/* stripe chunk size in bytes */
+	int		nf;
+	FILE		*f[IMG_MAXF];
+	unsigned long	segsize;	/* segment size in bytes */
+	int		cur;		/* segment open in f[0], -1 if none */
+	char		index[FILENAME_MAX];	/* segment names derive from this */
+	unsigned int	csect;		/* chunked formats: sectors per chunk */
+	unsigned long	*idx;		/* frame: offset of every istep-th track;
+					 * qcow2: L1 table */
+	unsigned int	nidx;
+	unsigned int	istep;
+	int		inorder;	/* frame: tracks came in order */
+	unsigned long	*resent;	/* frame: tracks sent again, last position */
+	unsigned int	nresent;
+	int		lastscan;	/* frame: too many of them, look through it all */
+	int		cbits;		/* qcow2: cluster bits */
+	struct aes_ctx	*aes;		/* key of an encrypted image */
+	unsigned long	session;	/* and the last session that wrote it */
+	imgtab		*tab;		/* E01 chunk tables */
+	unsigned int	ntab;
+	unsigned char	*raw;		/* chunk as stored */
+	unsigned int	rawlen;
+	unsigned char	*cbuf[IMG_CACHE];
+	unsigned long	cid[IMG_CACHE];	/* chunk number+1, 0 if slot empty */
+	unsigned long	cuse[IMG_CACHE];
+	unsigned long	clock;
+} rhimg;
+
+void img_key(const unsigned char *key);
+int img_open(rhimg *im, const char *fn);
+int img_read(rhimg *im, unsigned long lba, unsigned int count, void *buf);
+void img_close(rhimg *im);
+
+#endif
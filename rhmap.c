@@ -0,0 +1,297 @@
+/* rhmap.c - region map of a (partial) rawhdd image.
+ * Rebuilds which tracks were already copied from rawhdd.log, so that an
+ * interrupted run can be resumed against the partially written image.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "rhmap.h"
+
+int map_init(rhmap *m, unsigned int tracks, unsigned int heads, unsigned int sectors)
+{
+	unsigned long bytes;
+	memset(m,0,sizeof(rhmap));
+	m->tracks=tracks;
+	m->heads=heads;
+	m->sectors=sectors;
+	bytes=(map_ntracks(m)+7)/8;
+	if(bytes==0 || bytes>0xfff0UL)	/* must fit in one segment */
+		return -1;
+	m->done=calloc((unsigned int)bytes,1);
+	m->seen=calloc((unsigned int)bytes,1);
+	if(m->done==NULL || m->seen==NULL)
+	{
+		map_free(m);
+		return -1;
+	}
+	return 0;
+}
+
+/* forget everything, keep geometry */
+void map_clear(rhmap *m)
+{
+	unsigned int bytes=(unsigned int)((map_ntracks(m)+7)/8);
+	memset(m->done,0,bytes);
+	memset(m->seen,0,bytes);
+	m->nbad=0;
+}
+
+void map_free(rhmap *m)
+{
+	free(m->done);
+	free(m->seen);
+	free(m->bad);
+	m->done=m->seen=NULL;
+	m->bad=NULL;
+	m->nbad=m->maxbad=0;
+}
+
+unsigned long map_ntracks(rhmap *m)
+{
+	return (unsigned long)m->tracks*m->heads;
+}
+
+int map_done(rhmap *m, unsigned long trk)
+{
+	return (m->done[(unsigned int)(trk>>3)]>>(trk&7))&1;
+}
+
+int map_seen(rhmap *m, unsigned long trk)
+{
+	return (m->seen[(unsigned int)(trk>>3)]>>(trk&7))&1;
+}
+
+/* mark track as written; done=1 if all its sectors were read */
+void map_mark(rhmap *m, unsigned long trk, int done)
+{
+	unsigned char bit=1<<(trk&7);
+	m->seen[(unsigned int)(trk>>3)]|=bit;
+	if(done)
+		m->done[(unsigned int)(trk>>3)]|=bit;
+	else
+		m->done[(unsigned int)(trk>>3)]&=~bit;
+}
+
+/* number of tracks which are done */
+unsigned long map_count(rhmap *m)
+{
+	unsigned long t,n=0;
+	for(t=0;t<map_ntracks(m);t++)
+		n+=map_done(m,t);
+	return n;
+}
+
+int map_addbad(rhmap *m, unsigned long lba)
+{
+	unsigned long *nb;
+	if(map_isbad(m,lba))
+		return 0;
+	if(m->nbad==m->maxbad)
+	{
+		if(m->maxbad>=0x3ff0)	/* keep list within one segment */
+			return -1;
+		nb=realloc(m->bad,(m->maxbad+64)*sizeof(unsigned long));
+		if(nb==NULL)
+			return -1;
+		m->bad=nb;
+		m->maxbad+=64;
+	}
+	m->bad[m->nbad++]=lba;
+	return 0;
+}
+
+int map_isbad(rhmap *m, unsigned long lba)
+{
+	unsigned int i;
+	for(i=0;i<m->nbad;i++)
+		if(m->bad[i]==lba)
+			return 1;
+	return 0;
+}
+
+/* forget bad sectors of a track (it is being read again) */
+void map_dropbad(rhmap *m, unsigned long trk)
+{
+	unsigned int i=0;
+	unsigned long first=MAP_LBA(m,trk,1);
+	while(i<m->nbad)
+	{
+		if(m->bad[i]>=first && m->bad[i]<first+m->sectors)
+			m->bad[i]=m->bad[--m->nbad];
+		else
+			i++;
+	}
+}
+
+void ext_init(rhext *e, const char *tag, FILE *log)
+{
+	memset(e,0,sizeof(rhext));
+	e->tag=tag;
+	e->log=log;
+}
+
+/* add a sector; it is printed once the run it belongs to ends */
+void ext_add(rhext *e, unsigned long lba)
+{
+	if(e->n>0 && lba==e->first+e->n)
+	{
+		e->n++;
+		return;
+	}
+	ext_flush(e);
+	e->first=lba;
+	e->n=1;
+}
+
+void ext_flush(rhext *e)
+{
+	if(e->n==0)
+		return;
+	printf("%s: %lu-%lu (%lu sectors)\n",e->tag,e->first,e->first+e->n-1,e->n);
+	if(e->log!=NULL)
+		fprintf(e->log,"%s: %lu-%lu (%lu sectors)\n",e->tag,e->first,e->first+e->n-1,e->n);
+	e->total+=e->n;
+	e->runs++;
+	e->n=0;
+}
+
+/* name of a file kept next to the image: same name, extension ext, in
+ * out of size bytes; returns -1 (with a message) if it does not fit */
+int sidecar(char *out,unsigned int size,const char *fn,const char *ext)
+{
+	const char *p=strrchr(fn,'.');
+	unsigned int n;
+	if(p==NULL || strpbrk(p,"\\/:")!=NULL)	/* no extension */
+		p=fn+strlen(fn);
+	n=(unsigned int)(p-fn);
+	if(n+strlen(ext)+2>size)
+	{
+		printf("File name too long: %s\n",fn);
+		return -1;
+	}
+	memcpy(out,fn,n);
+	out[n]='.';
+	strcpy(out+n+1,ext);
+	return 0;
+}
+
+/* DOS file names are case insensitive */
+static int samename(const char *a, const char *b)
+{
+	while(*a && toupper(*a)==toupper(*b))
+	{
+		a++;
+		b++;
+	}
+	return toupper(*a)==toupper(*b);
+}
+
+/* parse log lines of the form "OK: c,h,*", "OK: c,h,s" and "ERR: c,h,s"
+ * that belong to sessions writing imgname. rawhdd.log may contain sessions
+ * for other images and other geometries; those are skipped.
+ * If m was not initialised (tracks==0) the geometry of the first matching
+ * session is used.
+ * Returns the number of sessions imported or -1 on error. */
+int map_import(rhmap *m, const char *logname, const char *imgname)
+{
+	FILE *f;
+	char line[160];
+	char *p;
+	char ok;
+	int insess=0;	/* 1: current session writes imgname with our geometry */
+	int fresh=0;	/* 1: session just started, not yet known if resumed */
+	int sessions=0;
+	unsigned int c,h,s,d;
+	unsigned long trk;
+	unsigned long cur=0xffffffffUL;	/* track being copied sector by sector */
+	int curbad=0;
+
+	f=fopen(logname,"rt");
+	if(f==NULL)
+		return -1;
+	while(fgets(line,sizeof(line),f)!=NULL)
+	{
+		if((p=strstr(line," copy started at "))!=NULL)
+		{
+			*p=0;
+			insess=samename(line,imgname)?-1:0;	/* -1: geometry not seen yet */
+			cur=0xffffffffUL;
+			continue;
+		}
+		if(insess==-1 && sscanf(line,"Drive %u CHS: %u,%u,%u",&d,&c,&h,&s)==4)
+		{
+			if(m->tracks==0 && map_init(m,c,h,s)!=0)
+			{
+				fclose(f);
+				return -1;
+			}
+			if(c==m->tracks && h==m->heads && s==m->sectors)
+			{
+				insess=1;
+				fresh=1;
+				sessions++;
+			}
+			else
+				insess=0;	/* different geometry, image layout differs */
+			continue;
+		}
+		if(insess!=1)
+			continue;
+		if(fresh)	/* a session that was not resumed truncated the image */
+		{
+			fresh=0;
+			if(strncmp(line,"Resuming",8)==0 || strncmp(line,"Updating",8)==0)
+				continue;
+			map_clear(m);
+		}
+		if(line[0]=='O')
+			ok=1;
+		else if(line[0]=='E')
+			ok=0;
+		else
+			continue;
+		p=strchr(line,' ');
+		if(p==NULL || sscanf(p,"%u,%u,",&c,&h)!=2 || c>=m->tracks || h>=m->heads)
+			continue;
+		trk=MAP_TRK(m,c,h);
+		p=strrchr(line,',');
+		if(ok && p[1]=='*')	/* whole track */
+		{
+			map_dropbad(m,trk);
+			map_mark(m,trk,1);
+			continue;
+		}
+		s=atoi(p+1);
+		if(s<1 || s>m->sectors)
+			continue;
+		if(s==1)	/* copy_sects starts over with this track */
+		{
+			map_dropbad(m,trk);
+			cur=trk;
+			curbad=0;
+		}
+		if(trk!=cur)
+			continue;
+		if(!ok)
+		{
+			curbad=1;
+			if(map_addbad(m,MAP_LBA(m,trk,s))!=0)
+			{
+				fclose(f);
+				return -1;
+			}
+		}
+		if(s==m->sectors)	/* last sector of the track written */
+		{
+			map_mark(m,trk,!curbad);
+			cur=0xffffffffUL;
+		}
+	}
+	fclose(f);
+	return sessions;
+}
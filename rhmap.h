@@ -0,0 +1,63 @@
+/* rhmap.h - region map of a (partial) rawhdd image.
+ * The map is rebuilt from the text log written by rawhdd (rawhdd.log)
+ * and tells which tracks of an image already hold good data.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#ifndef RHMAP_H
+#define RHMAP_H
+
+#include <stdio.h>
+
+#define NAMELEN		FILENAME_MAX	/* file name with its path (80 under DOS) */
+
+/* region map: one bit per track (cylinder/head pair) plus a short list
+ * of sectors that could not be read */
+typedef struct rhmap
+{
+	unsigned int	tracks;		/* geometry of the image */
+	unsigned int	heads;
+	unsigned int	sectors;
+	unsigned char	*done;		/* track written, all sectors read OK */
+	unsigned char	*seen;		/* track written (maybe with errors) */
+	unsigned long	*bad;		/* LBAs of unreadable sectors */
+	unsigned int	nbad;
+	unsigned int	maxbad;
+} rhmap;
+
+/* run of consecutive sectors, reported as "<tag>: first-last (n sectors)" */
+typedef struct rhext
+{
+	const char	*tag;
+	FILE		*log;		/* reported here too if not NULL */
+	unsigned long	first;
+	unsigned long	n;		/* sectors in pending run, 0 if none */
+	unsigned long	total;		/* sectors reported so far */
+	unsigned long	runs;
+} rhext;
+
+/* track number from cylinder and head (tracks are stored in this order) */
+#define MAP_TRK(m,c,h)	((unsigned long)(c)*(m)->heads+(h))
+/* LBA of sector s (1 based) from track t */
+#define MAP_LBA(m,t,s)	((unsigned long)(t)*(m)->sectors+(s)-1)
+
+int map_init(rhmap *m, unsigned int tracks, unsigned int heads, unsigned int sectors);
+void map_clear(rhmap *m);
+void map_free(rhmap *m);
+unsigned long map_ntracks(rhmap *m);
+int map_done(rhmap *m, unsigned long trk);
+int map_seen(rhmap *m, unsigned long trk);
+void map_mark(rhmap *m, unsigned long trk, int done);
+unsigned long map_count(rhmap *m);
+int map_addbad(rhmap *m, unsigned long lba);
+int map_isbad(rhmap *m, unsigned long lba);
+void map_dropbad(rhmap *m, unsigned long trk);
+int map_import(rhmap *m, const char *logname, const char *imgname);
+void ext_init(rhext *e, const char *tag, FILE *log);
+void ext_add(rhext *e, unsigned long lba);
+void ext_flush(rhext *e);
+int sidecar(char *out, unsigned int size, const char *fn, const char *ext);
+
+#endif
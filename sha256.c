@@ -0,0 +1,118 @@
+/* sha256.c - SHA-256 (FIPS 180-4) in portable C.
+ * Written for 16 bit compilers: unsigned long is (at least) 32 bits, so
+ * every result that may carry past bit 31 is masked.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <string.h>
+#include "sha256.h"
+
+#define M32(x)		((x)&0xffffffffUL)
+#define ROTR(x,n)	M32(((x)>>(n))|((x)<<(32-(n))))
+#define CH(x,y,z)	(((x)&(y))^(~(x)&(z)))
+#define MAJ(x,y,z)	(((x)&(y))^((x)&(z))^((y)&(z)))
+#define EP0(x)		(ROTR(x,2)^ROTR(x,13)^ROTR(x,22))
+#define EP1(x)		(ROTR(x,6)^ROTR(x,11)^ROTR(x,25))
+#define SIG0(x)		(ROTR(x,7)^ROTR(x,18)^((x)>>3))
+#define SIG1(x)		(ROTR(x,17)^ROTR(x,19)^((x)>>10))
+
+static const unsigned long k[64]=
+{
+	0x428a2f98UL,0x71374491UL,0xb5c0fbcfUL,0xe9b5dba5UL,0x3956c25bUL,0x59f111f1UL,0x923f82a4UL,0xab1c5ed5UL,
+	0xd807aa98UL,0x12835b01UL,0x243185beUL,0x550c7dc3UL,0x72be5d74UL,0x80deb1feUL,0x9bdc06a7UL,0xc19bf174UL,
+	0xe49b69c1UL,0xefbe4786UL,0x0fc19dc6UL,0x240ca1ccUL,0x2de92c6fUL,0x4a7484aaUL,0x5cb0a9dcUL,0x76f988daUL,
+	0x983e5152UL,0xa831c66dUL,0xb00327c8UL,0xbf597fc7UL,0xc6e00bf3UL,0xd5a79147UL,0x06ca6351UL,0x14292967UL,
+	0x27b70a85UL,0x2e1b2138UL,0x4d2c6dfcUL,0x53380d13UL,0x650a7354UL,0x766a0abbUL,0x81c2c92eUL,0x92722c85UL,
+	0xa2bfe8a1UL,0xa81a664bUL,0xc24b8b70UL,0xc76c51a3UL,0xd192e819UL,0xd6990624UL,0xf40e3585UL,0x106aa070UL,
+	0x19a4c116UL,0x1e376c08UL,0x2748774cUL,0x34b0bcb5UL,0x391c0cb3UL,0x4ed8aa4aUL,0x5b9cca4fUL,0x682e6ff3UL,
+	0x748f82eeUL,0x78a5636fUL,0x84c87814UL,0x8cc70208UL,0x90befffaUL,0xa4506cebUL,0xbef9a3f7UL,0xc67178f2UL
+};
+
+static void transform(sha256_ctx *c, const unsigned char *p)
+{
+	unsigned long w[16];
+	unsigned long a,b,d,e,f,g,h,cc,t1,t2;
+	int i;
+
+	for(i=0;i<16;i++,p+=4)
+		w[i]=((unsigned long)p[0]<<24)|((unsigned long)p[1]<<16)|((unsigned long)p[2]<<8)|p[3];
+	a=c->h[0]; b=c->h[1]; cc=c->h[2]; d=c->h[3];
+	e=c->h[4]; f=c->h[5]; g=c->h[6]; h=c->h[7];
+	for(i=0;i<64;i++)
+	{
+		/* message schedule is kept as a 16 word ring */
+		if(i>=16)
+			w[i&15]=M32(SIG1(w[(i-2)&15])+w[(i-7)&15]+SIG0(w[(i-15)&15])+w[i&15]);
+		t1=M32(h+EP1(e)+CH(e,f,g)+k[i]+w[i&15]);
+		t2=M32(EP0(a)+MAJ(a,b,cc));
+		h=g; g=f; f=e;
+		e=M32(d+t1);
+		d=cc; cc=b; b=a;
+		a=M32(t1+t2);
+	}
+	c->h[0]=M32(c->h[0]+a); c->h[1]=M32(c->h[1]+b);
+	c->h[2]=M32(c->h[2]+cc); c->h[3]=M32(c->h[3]+d);
+	c->h[4]=M32(c->h[4]+e); c->h[5]=M32(c->h[5]+f);
+	c->h[6]=M32(c->h[6]+g); c->h[7]=M32(c->h[7]+h);
+}
+
+void sha256_init(sha256_ctx *c)
+{
+	c->h[0]=0x6a09e667UL; c->h[1]=0xbb67ae85UL;
+	c->h[2]=0x3c6ef372UL; c->h[3]=0xa54ff53aUL;
+	c->h[4]=0x510e527fUL; c->h[5]=0x9b05688cUL;
+	c->h[6]=0x1f83d9abUL; c->h[7]=0x5be0cd19UL;
+	c->lo=c->hi=0;
+	c->n=0;
+}
+
+void sha256_update(sha256_ctx *c, const void *data, unsigned int len)
+{
+	const unsigned char *p=data;
+	unsigned int m;
+
+	c->lo=M32(c->lo+len);
+	if(c->lo<len)
+		c->hi++;
+	while(len>0)
+	{
+		m=64-c->n;
+		if(m>len)
+			m=len;
+		memcpy(c->buf+c->n,p,m);
+		c->n+=m;
+		p+=m;
+		len-=m;
+		if(c->n==64)
+		{
+			transform(c,c->buf);
+			c->n=0;
+		}
+	}
+}
+
+void sha256_final(sha256_ctx *c, unsigned char out[32])
+{
+	unsigned long hibits=M32((c->hi<<3)|(c->lo>>29));
+	unsigned long lobits=M32(c->lo<<3);
+	int i;
+
+	c->buf[c->n++]=0x80;
+	if(c->n>56)
+	{
+		memset(c->buf+c->n,0,64-c->n);
+		transform(c,c->buf);
+		c->n=0;
+	}
+	memset(c->buf+c->n,0,56-c->n);
+	for(i=0;i<4;i++)
+	{
+		c->buf[56+i]=(unsigned char)(hibits>>(24-8*i));
+		c->buf[60+i]=(unsigned char)(lobits>>(24-8*i));
+	}
+	transform(c,c->buf);
+	for(i=0;i<32;i++)
+		out[i]=(unsigned char)(c->h[i>>2]>>(24-8*(i&3)));
+}
@@ -0,0 +1,20 @@
+/* sha256.h - SHA-256 (FIPS 180-4) in portable C.
+ * Works with 16 bit ints; all 32 bit arithmetic uses unsigned long.
+ */
+
+#ifndef SHA256_H
+#define SHA256_H
+
+typedef struct sha256_ctx
+{
+	unsigned long	h[8];
+	unsigned long	lo, hi;		/* message length in bytes */
+	unsigned char	buf[64];
+	unsigned int	n;		/* bytes in buf */
+} sha256_ctx;
+
+void sha256_init(sha256_ctx *c);
+void sha256_update(sha256_ctx *c, const void *data, unsigned int len);
+void sha256_final(sha256_ctx *c, unsigned char out[32]);
+
+#endif
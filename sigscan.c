@@ -0,0 +1,146 @@
+/* sigscan.c - file signatures (magic bytes) at the start of sectors.
+ * Signatures are bucketed by their first byte, so a sector costs one
+ * table lookup unless that byte starts some signature.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "sigscan.h"
+
+typedef struct sig
+{
+	char		name[SIG_NAMELEN];
+	unsigned int	off;		/* of the pattern within the sector */
+	unsigned int	len;
+	unsigned char	pat[SIG_PATLEN];
+	int		next;		/* next one at the same offset and first byte, -1 */
+} sig;
+
+static sig sigs[SIG_MAX];
+static int nsig=0;
+static int first[256];		/* signatures at offset 0, by first byte */
+static int other=-1;		/* signatures at other offsets */
+
+/* used when no signature file is given */
+static const char *builtin[]={
+	"JPEG 0 FFD8FF",
+	"PNG 0 89504E470D0A1A0A",
+	"GIF 0 47494638",
+	"PDF 0 255044462D",
+	"ZIP 0 504B0304",
+	"RAR 0 526172211A07",
+	"7Z 0 377ABCAF271C",
+	"GZIP 0 1F8B08",
+	"BZIP2 0 425A6839",
+	"SQLITE 0 53514C69746520666F726D6174203300",
+	"OLE2 0 D0CF11E0A1B11AE1",
+	"RIFF 0 52494646",
+	"ELF 0 7F454C46",
+	"ID3 0 494433",
+	"PST 0 2142444E",
+	"TAR 257 7573746172",
+	NULL
+};
+
+/* parse "name offset hex"; returns 0, 1 if the line holds none, -1 if bad */
+static int add(const char *line)
+{
+	char name[SIG_NAMELEN], hex[2*SIG_PATLEN+2];
+	unsigned int off, i, v;
+	sig *s=&sigs[nsig];
+
+	while(*line==' ' || *line=='\t')
+		line++;
+	if(*line=='#' || *line=='\r' || *line=='\n' || *line==0)
+		return 1;
+	if(nsig==SIG_MAX || sscanf(line,"%11s %u %33s",name,&off,hex)!=3)
+		return -1;
+	s->len=strlen(hex)/2;
+	if(s->len==0 || s->len>SIG_PATLEN || strlen(hex)%2 || strspn(hex,"0123456789ABCDEFabcdef")!=strlen(hex) || off+s->len>512)
+		return -1;
+	for(i=0;i<s->len;i++)
+	{
+		if(sscanf(hex+2*i,"%2x",&v)!=1)
+			return -1;
+		s->pat[i]=(unsigned char)v;
+	}
+	strcpy(s->name,name);
+	s->off=off;
+	if(off==0)
+	{
+		s->next=first[s->pat[0]];
+		first[s->pat[0]]=nsig;
+	}
+	else
+	{
+		s->next=other;
+		other=nsig;
+	}
+	nsig++;
+	return 0;
+}
+
+/* fn==NULL: the built-in list; returns number of signatures, -1 on error */
+int sig_load(const char *fn)
+{
+	FILE *f;
+	char line[128];
+	int i;
+
+	nsig=0;
+	other=-1;
+	for(i=0;i<256;i++)
+		first[i]=-1;
+	if(fn==NULL)
+	{
+		for(i=0;builtin[i]!=NULL;i++)
+			add(builtin[i]);
+		return nsig;
+	}
+	if((f=fopen(fn,"rt"))==NULL)
+		return -1;
+	while(fgets(line,sizeof(line),f)!=NULL)
+		if(add(line)<0)
+		{
+			fclose(f);
+			return -1;
+		}
+	fclose(f);
+	return nsig;
+}
+
+/* signatures of chain i found at p; returns hits, -1 on write error */
+static int match(FILE *out, unsigned long lba, const unsigned char *p, int i)
+{
+	int hits=0;
+	for(;i>=0;i=sigs[i].next)
+		if(memcmp(p+sigs[i].off,sigs[i].pat,sigs[i].len)==0)
+		{
+			if(fprintf(out,"%lu %s\n",lba,sigs[i].name)<0)
+				return -1;
+			hits++;
+		}
+	return hits;
+}
+
+/* record the signatures found at the start of each sector of buf; returns
+ * number of hits, -1 if out can't be written */
+int sig_scan(FILE *out, unsigned long lba, const unsigned char *buf, unsigned int sectors)
+{
+	unsigned int n;
+	int a, b, hits=0;
+	const unsigned char *p;
+
+	for(n=0;n<sectors;n++)
+	{
+		p=buf+512*n;
+		if((a=match(out,lba+n,p,first[*p]))<0 || (b=match(out,lba+n,p,other))<0)
+			return -1;
+		hits+=a+b;
+	}
+	return hits;
+}
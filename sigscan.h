@@ -0,0 +1,23 @@
+/* sigscan.h - file signatures (magic bytes) at the start of sectors.
+ * Files start on cluster, hence sector, boundaries, so checking each
+ * sector start finds the headers a carving tool would look for without
+ * reading the image again.
+ */
+
+#ifndef SIGSCAN_H
+#define SIGSCAN_H
+
+#define SIG_MAX		64	/* signatures */
+#define SIG_NAMELEN	12
+#define SIG_PATLEN	16
+
+/* Signature file: one "name offset hex_bytes" per line, offset within the
+ * sector (pattern must fit in its 512 bytes), '#' starts a comment, e.g.
+ *   JPEG 0 FFD8FF
+ *   TAR 257 7573746172
+ * .SIG index: "RAWHDD SIGNATURES", then one "LBA name" line per hit, in
+ * the order tracks were copied. */
+int sig_load(const char *fn);
+int sig_scan(FILE *out, unsigned long lba, const unsigned char *buf, unsigned int sectors);
+
+#endif
@@ -0,0 +1,112 @@
+/* aes_kat - known answers for aes.c: the AES-256 example of FIPS 197
+ * (appendix C.3) and the AES-256 GCM test cases without additional data
+ * (13, 14 and 15) of the GCM specification. Decryption must give the
+ * plaintext back and refuse a changed byte or tag.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "aes.h"
+
+typedef struct kat
+{
+	const char	*key, *iv, *pt, *ct, *tag;
+} kat;
+
+static const kat gcm[]=
+{
+	{	/* test case 13 */
+		"0000000000000000000000000000000000000000000000000000000000000000",
+		"000000000000000000000000",
+		"",
+		"",
+		"530f8afbc74536b9a963b4f1c4cb738b"
+	},
+	{	/* test case 14 */
+		"0000000000000000000000000000000000000000000000000000000000000000",
+		"000000000000000000000000",
+		"00000000000000000000000000000000",
+		"cea7403d4d606b6e074ec5d3baf39d18",
+		"d0d1c8a799996bf0265b98b5d48ab919"
+	},
+	{	/* test case 15 */
+		"feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308",
+		"cafebabefacedbaddecaf888",
+		"d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72"
+		"1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b391aafd255",
+		"522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+		"8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662898015ad",
+		"b094dac5d93471bdec1a502270e3cc6c"
+	}
+};
+
+/* hex to bytes, returns the length */
+static unsigned int unhex(const char *s, unsigned char *out)
+{
+	unsigned int n, v;
+	for(n=0;s[2*n]!=0;n++)
+	{
+		sscanf(s+2*n,"%2x",&v);
+		out[n]=(unsigned char)v;
+	}
+	return n;
+}
+
+static int fail(const char *what, int i)
+{
+	printf("aes_kat: %s, test %d\n",what,i);
+	return 1;
+}
+
+int main(void)
+{
+	static aes_ctx c;
+	unsigned char key[AES_KEYLEN], iv[AES_IVLEN], buf[64], pt[64], ct[64];
+	unsigned char tag[AES_TAGLEN], want[AES_TAGLEN];
+	unsigned int n;
+	int i;
+
+	unhex("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f",key);
+	unhex("00112233445566778899aabbccddeeff",pt);
+	unhex("8ea2b7ca516745bfeafc49904b496089",ct);
+	aes_setkey(&c,key);
+	aes_block(&c,pt,buf);
+	if(memcmp(buf,ct,16)!=0)
+		return fail("AES-256 block",0);
+
+	for(i=0;i<(int)(sizeof(gcm)/sizeof(gcm[0]));i++)
+	{
+		unhex(gcm[i].key,key);
+		unhex(gcm[i].iv,iv);
+		n=unhex(gcm[i].pt,pt);
+		unhex(gcm[i].ct,ct);
+		unhex(gcm[i].tag,want);
+		aes_setkey(&c,key);
+		memcpy(buf,pt,n);
+		aes_gcm_encrypt(&c,iv,buf,n,tag);
+		if(memcmp(buf,ct,n)!=0)
+			return fail("ciphertext",i+13);
+		if(memcmp(tag,want,AES_TAGLEN)!=0)
+			return fail("tag",i+13);
+		if(aes_gcm_decrypt(&c,iv,buf,n,tag)!=0 || memcmp(buf,pt,n)!=0)
+			return fail("decryption",i+13);
+		memcpy(buf,ct,n);
+		tag[AES_TAGLEN-1]^=1;
+		if(aes_gcm_decrypt(&c,iv,buf,n,tag)==0)
+			return fail("changed tag accepted",i+13);
+		tag[AES_TAGLEN-1]^=1;
+		if(n>0)
+		{
+			memcpy(buf,ct,n);
+			buf[n/2]^=0x80;
+			if(aes_gcm_decrypt(&c,iv,buf,n,tag)==0)
+				return fail("changed ciphertext accepted",i+13);
+		}
+	}
+	printf("aes_kat: ok\n");
+	return 0;
+}
@@ -0,0 +1,305 @@
+/* ewf_check - E01 images from ewf.c, walked section by section without
+ * rhimg: every segment within its size, descriptors chained and summed,
+ * table and table2 alike, every chunk where its entry says with the
+ * right data and Adler-32 (or the zlib stream of a zero chunk), chunk
+ * tables split at EWF_MAXTAB, the unreadable sectors in error2 and the
+ * MD5 of the media in hash. Then reads the image back through rhimg.
+ * Done for a mixed image over many segments, and for one full table
+ * ending in a stored chunk, with a segment size that leaves room for the
+ * chunks and tables but not for error2, hash and done after them.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ewf.h"
+#include "md5.h"
+#include "rhimg.h"
+
+#define CHUNKBYTES	(EWF_CHUNK*512)
+#define FN		"ewchk.E01"
+#define SECTLEN		76
+#define MAXSPT		63
+
+typedef struct layout
+{
+	unsigned int	cyls, heads, spt;
+	unsigned long	zchunks;	/* zero chunks first, then one in three isn't */
+	unsigned long	segsize;	/* 0: just too small for one segment */
+	unsigned long	bad[3][2];	/* unreadable sectors, first/count */
+} layout;
+
+static const layout cases[2]=
+{
+	{1100,16,63,16500UL,0x100000UL,{{1100000UL,5},{1105000UL,1},{1108000UL,63}}},
+	{1310,16,50,EWF_MAXTAB-3,0,{{1047990UL,1},{0,0},{0,0}}}
+};
+static const layout *L;
+static unsigned long sectors;
+#define NBAD	3
+
+static unsigned char *seg;	/* segment file being checked */
+static unsigned long segsz;
+static unsigned char chunk[CHUNKBYTES];
+
+static unsigned long get32le(const unsigned char *p)
+{
+	return p[0]|((unsigned long)p[1]<<8)|((unsigned long)p[2]<<16)|((unsigned long)p[3]<<24);
+}
+
+static unsigned long adler32(const unsigned char *p, unsigned long n)
+{
+	unsigned long s1=1, s2=0;
+	while(n-->0)
+	{
+		s1=(s1+*p++)%65521UL;
+		s2=(s2+s1)%65521UL;
+	}
+	return (s2<<16)|s1;
+}
+
+static int isbad(unsigned long lba)
+{
+	unsigned int i;
+	for(i=0;i<NBAD;i++)
+		if(lba>=L->bad[i][0] && lba<L->bad[i][0]+L->bad[i][1])
+			return 1;
+	return 0;
+}
+
+/* contents of a sector: zeros at first and in two chunks of three after,
+ * and where it could not be read */
+static void fill(unsigned char *buf, unsigned long lba)
+{
+	unsigned long ch=lba/EWF_CHUNK;
+	unsigned int i;
+	if(ch<L->zchunks || ch%3!=0 || isbad(lba))
+		memset(buf,0,512);
+	else
+		for(i=0;i<512;i++)
+			buf[i]=(unsigned char)(lba*5+i%241+1);
+}
+
+static int fail(const char *what, unsigned int s)
+{
+	printf("ewf_check: %s (segment %u)\n",what,s);
+	return 1;
+}
+
+static int load(unsigned int s)
+{
+	char name[32];
+	FILE *f;
+	sprintf(name,"ewchk.E%02u",s);
+	if((f=fopen(name,"rb"))==NULL)
+		return -1;
+	fseek(f,0L,SEEK_END);
+	segsz=ftell(f);
+	rewind(f);
+	free(seg);
+	if((seg=malloc(segsz))==NULL || fread(seg,1,segsz,f)!=segsz)
+		return -1;
+	fclose(f);
+	return 0;
+}
+
+/* a table's chunks lie in the sectors section that ends where it starts */
+static int check_table(unsigned int s, unsigned long off, unsigned long end,
+	unsigned long *nch)
+{
+	static const unsigned char zhead[2]={0x78,0xda};
+	unsigned char *t=seg+off+SECTLEN;
+	unsigned long n=get32le(t), base=get32le(t+8), i, a, b, lba;
+	unsigned int k;
+
+	if(adler32(t,20)!=get32le(t+20) || adler32(t+24,4*n)!=get32le(t+24+4*n))
+		return fail("table checksum",s);
+	if(n==0 || n>EWF_MAXTAB)
+		return fail("table size",s);
+	for(i=0;i<n;i++,(*nch)++)
+	{
+		a=base+(get32le(t+24+4*i)&0x7fffffffUL);
+		b=i+1<n?base+(get32le(t+24+4*i+4)&0x7fffffffUL):end;
+		if(b<=a || b>end)
+			return fail("chunk offsets",s);
+		for(k=0;k<EWF_CHUNK;k++)
+		{
+			lba=*nch*EWF_CHUNK+k;
+			fill(chunk+512*k,lba);
+		}
+		if(get32le(t+24+4*i)&0x80000000UL)
+		{
+			for(k=0;k<CHUNKBYTES && chunk[k]==0;k++)
+				;
+			if(k<CHUNKBYTES || b-a!=52 || memcmp(seg+a,zhead,2)!=0)
+				return fail("compressed chunk that isn't zeros",s);
+		}
+		else if(b-a!=CHUNKBYTES+4 || memcmp(seg+a,chunk,CHUNKBYTES)!=0 ||
+			adler32(seg+a,CHUNKBYTES)!=get32le(seg+a+CHUNKBYTES))
+			return fail("chunk data",s);
+	}
+	return 0;
+}
+
+static int write_image(unsigned long segsize)
+{
+	static char buf[MAXSPT*512];
+	unsigned char badm[MAXSPT];
+	ewfout e;
+	unsigned long trk, lba;
+	unsigned int i;
+	int anybad;
+
+	if(ewf_open(&e,FN,L->cyls,L->heads,L->spt,segsize)!=0)
+		return -1;
+	for(trk=0;trk<(unsigned long)L->cyls*L->heads;trk++)
+	{
+		anybad=0;
+		for(i=0;i<L->spt;i++)
+		{
+			lba=trk*L->spt+i;
+			fill((unsigned char *)buf+512*i,lba);
+			badm[i]=(unsigned char)isbad(lba);
+			anybad|=badm[i];
+		}
+		if(ewf_write(&e,buf,L->spt,anybad?badm:NULL)!=0)
+			return -1;
+	}
+	return ewf_close(&e,1);
+}
+
+static int check_case(void)
+{
+	static unsigned char sect[MAXSPT*512], want[MAXSPT*512];
+	md5_ctx m;
+	unsigned char sum[16];
+	unsigned long segsize=L->segsize, off, next, size, nch, tabat, secend, trk, i;
+	unsigned int s, k, nbad;
+	int last=0, tables=0, shorttab;
+	unsigned int spt=L->spt;
+	rhimg im;
+
+	sectors=(unsigned long)L->cyls*L->heads*spt;
+	for(nbad=0;nbad<NBAD && L->bad[nbad][1]>0;nbad++)
+		;
+	if(segsize==0)	/* one segment as it comes out, less a little */
+	{
+		if(write_image(0x7fffffffUL)!=0 || load(1)!=0)
+			return fail("writing failed",1);
+		segsize=segsz-64;
+	}
+	if(write_image(segsize)!=0)
+		return fail("writing failed",0);
+
+	nch=0;
+	for(s=1;!last;s++)
+	{
+		if(load(s)!=0)
+			return fail("missing",s);
+		if(segsz>segsize)
+			return fail("larger than the segment size",s);
+		if(memcmp(seg,"EVF\x09\x0d\x0a\xff\x00",8)!=0 || (unsigned int)(seg[9]|(seg[10]<<8))!=s)
+			return fail("file header",s);
+		tabat=secend=0;
+		shorttab=0;
+		for(off=13;;off=next)
+		{
+			if(off+SECTLEN>segsz || adler32(seg+off,72)!=get32le(seg+off+72))
+				return fail("section descriptor",s);
+			next=get32le(seg+off+16);
+			size=get32le(seg+off+24);
+			if(strcmp((char *)seg+off,"next")==0 || strcmp((char *)seg+off,"done")==0)
+			{
+				if(next!=off || off+SECTLEN!=segsz)
+					return fail("segment doesn't end with next or done",s);
+				last=strcmp((char *)seg+off,"done")==0;
+				break;
+			}
+			if(next!=off+size || next>segsz)
+				return fail("sections not chained",s);
+			if(strcmp((char *)seg+off,"sectors")==0)
+			{
+				if(shorttab)
+					return fail("table ended before EWF_MAXTAB mid segment",s);
+				secend=next;
+			}
+			else if(strcmp((char *)seg+off,"table")==0)
+			{
+				i=nch;
+				if(off!=secend || check_table(s,off,off,&nch)!=0)
+					return fail("table",s);
+				shorttab=nch-i<EWF_MAXTAB;
+				tabat=off;
+				tables++;
+			}
+			else if(strcmp((char *)seg+off,"table2")==0)
+			{
+				if(tabat==0 || size!=get32le(seg+tabat+24) ||
+					memcmp(seg+off+SECTLEN,seg+tabat+SECTLEN,size-SECTLEN)!=0)
+					return fail("table2 differs from table",s);
+				tabat=0;
+			}
+			else if(strcmp((char *)seg+off,"volume")==0 || strcmp((char *)seg+off,"data")==0)
+			{
+				if(get32le(seg+off+SECTLEN+4)!=sectors/EWF_CHUNK ||
+					get32le(seg+off+SECTLEN+16)!=sectors)
+					return fail("volume",s);
+			}
+			else if(strcmp((char *)seg+off,"error2")==0)
+			{
+				if(get32le(seg+off+SECTLEN)!=nbad)
+					return fail("error2 count",s);
+				for(k=0;k<nbad;k++)
+					if(get32le(seg+off+SECTLEN+520+8*k)!=L->bad[k][0] ||
+						get32le(seg+off+SECTLEN+524+8*k)!=L->bad[k][1])
+						return fail("error2 runs",s);
+			}
+			else if(strcmp((char *)seg+off,"hash")==0)
+			{
+				md5_init(&m);
+				for(i=0;i<sectors;i++)
+				{
+					fill(sect,i);
+					md5_update(&m,sect,512);
+				}
+				md5_final(&m,sum);
+				if(memcmp(seg+off+SECTLEN,sum,16)!=0)
+					return fail("hash",s);
+			}
+		}
+	}
+	if(nch!=sectors/EWF_CHUNK)
+		return fail("chunks missing from the tables",s-1);
+	if(s<3 || tables<(int)s-1)	/* s is one past the last segment */
+		return fail("too few segments or tables to be a test",s-1);
+
+	if(img_open(&im,FN)!=0 || im.sectors!=sectors)
+		return fail("rhimg can't open it",0);
+	for(trk=0;trk<(unsigned long)L->cyls*L->heads;trk++)
+	{
+		for(k=0;k<spt;k++)
+			fill(want+512*k,trk*spt+k);
+		if(img_read(&im,trk*spt,spt,sect)!=0 || memcmp(sect,want,spt*512)!=0)
+			return fail("rhimg reads it back wrong",0);
+	}
+	img_close(&im);
+	for(k=1;k<s;k++)
+	{
+		char name[32];
+		sprintf(name,"ewchk.E%02u",k);
+		remove(name);
+	}
+	return 0;
+}
+
+int main(void)
+{
+	for(L=cases;L<cases+2;L++)
+		if(check_case()!=0)
+			return 1;
+	printf("ewf_check: ok\n");
+	return 0;
+}
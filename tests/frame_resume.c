@@ -0,0 +1,83 @@
+/* frame_resume - a frame file written in several runs (later ones with
+ * keep, as rawhdd -r and -u do) must read back with the last data sent
+ * for every track: a resumed run goes on from where the first stopped,
+ * an update after the end frame sends tracks 3 and 4 again, twice.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "rhdest.h"
+#include "rhimg.h"
+
+#define TRACKS	20
+#define SPT	17
+#define FN	"frres.frm"
+
+/* contents of track trk as written by run gen */
+static void fill(char *buf, unsigned long trk, int gen)
+{
+	unsigned int i;
+	for(i=0;i<SPT*512;i++)
+		buf[i]=(char)(trk*7+i%251+1+gen*64);
+}
+
+/* gen of the last run that wrote trk */
+static int last_gen(unsigned long trk)
+{
+	return trk==3 || trk==4?2:0;
+}
+
+static int run(int keep, unsigned long from, unsigned long to, int gen, int complete)
+{
+	static char spec[]=FN;
+	char buf[SPT*512];
+	dest d;
+	unsigned long t;
+	memset(&d,0,sizeof(d));
+	if(dst_init(&d,spec,FMT_FRAME,1)!=0 || dst_open(&d,keep)!=0)
+		return -1;
+	for(t=from;t<to;t++)
+	{
+		fill(buf,t,gen);
+		if(dst_track(&d,t,buf,NULL)!=0)
+			return -1;
+	}
+	return dst_close(&d,complete);
+}
+
+int main(void)
+{
+	rhimg im;
+	char buf[SPT*512], got[SPT*512];
+	unsigned long t;
+
+	dst_geometry(TRACKS,1,SPT);
+	if(run(0,0,12,0,0)!=0 || run(1,12,TRACKS,0,1)!=0 ||
+		run(1,3,5,1,1)!=0 || run(1,3,5,2,1)!=0)
+	{
+		printf("FAIL: writing %s\n",FN);
+		return 1;
+	}
+	if(img_open(&im,FN)!=0)
+	{
+		printf("FAIL: opening %s\n",FN);
+		return 1;
+	}
+	for(t=0;t<TRACKS;t++)
+	{
+		fill(buf,t,last_gen(t));
+		if(img_read(&im,t*SPT,SPT,got)!=0 || memcmp(buf,got,sizeof(got))!=0)
+		{
+			printf("FAIL: track %lu is not the one sent last\n",t);
+			return 1;
+		}
+	}
+	img_close(&im);
+	remove(FN);
+	printf("frame_resume: ok\n");
+	return 0;
+}
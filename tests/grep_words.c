@@ -0,0 +1,55 @@
+/* grep_words - an image of two tracks with a .TRI index: the first holds
+ * words the filters can't rule out (a 3 letter word on its own, a word
+ * with a tab), the second no text at all. tri_maybe must let the first
+ * track through for them; run.sh then has rawgrep find them.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "trigram.h"
+#include "crc32c.h"
+
+#define SPT	17
+#define FN	"grw.img"
+#define TRI	"grw.TRI"
+
+int main(void)
+{
+	static unsigned char buf[2][SPT*512], bloom[2][TRI_BYTES(SPT*512)];
+	unsigned char hdr[TRI_HDRLEN];
+	FILE *f;
+	unsigned int i;
+	int t;
+
+	for(t=0;t<2;t++)	/* binary, no runs of printable bytes */
+	{
+		for(i=0;i<SPT*512;i++)
+			buf[t][i]=(unsigned char)(0x80+(i*7+t)%0x80);
+	}
+	memcpy(buf[0]+1000,"\0Cat\0",5);
+	memcpy(buf[0]+3000,"\0ab\tcd\0",7);
+	for(t=0;t<2;t++)
+		tri_block(buf[t],SPT*512,bloom[t]);
+	if(!tri_maybe(bloom[0],sizeof(bloom[0]),"cat") || !tri_maybe(bloom[0],sizeof(bloom[0]),"ab\tcd"))
+	{
+		printf("grep_words: unindexed word ruled out\n");
+		return 1;
+	}
+	if(tri_maybe(bloom[1],sizeof(bloom[1]),"words"))
+	{
+		printf("grep_words: empty filter allows a word\n");
+		return 1;
+	}
+	if((f=fopen(FN,"wb"))==NULL || fwrite(buf,sizeof(buf),1,f)!=1 || fclose(f)!=0)
+		return 1;
+	memcpy(hdr,"RHT1",4);
+	put32le(hdr+4,SPT*512);
+	if((f=fopen(TRI,"wb"))==NULL || fwrite(hdr,TRI_HDRLEN,1,f)!=1 ||
+		fwrite(bloom,sizeof(bloom),1,f)!=1 || fclose(f)!=0)
+		return 1;
+	printf("grep_words: ok\n");
+	return 0;
+}
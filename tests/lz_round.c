@@ -0,0 +1,135 @@
+/* lz_round - lz_pack/lz_unpack round trips on data that compresses well,
+ * poorly and not at all, at sizes around the block format's limits
+ * (empty, below MFLIMIT, long literal and match runs, a full 64K-1
+ * buffer). Also decodes a block written by the reference LZ4 compressor,
+ * checks that a too small output gives 0, and that damaged blocks are
+ * refused without writing past the output.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lz.h"
+
+#define MAXN	0xffffU
+#define GUARD	64
+
+/* 336 'A's then TEXT, as compressed by liblz4 (LZ4_compress_default) */
+#define TEXT	"rawhdd reads a drive, rawhdd writes an image; rawhdd reads a drive again."
+static const unsigned char ref[]=
+	"\x1f\x41\x01\x00\xff\x3d\xf3\x07\x72\x61\x77\x68\x64\x64\x20\x72"
+	"\x65\x61\x64\x73\x20\x61\x20\x64\x72\x69\x76\x65\x2c\x20\x16\x00"
+	"\xf4\x01\x77\x72\x69\x74\x65\x73\x20\x61\x6e\x20\x69\x6d\x61\x67"
+	"\x65\x3b\x18\x00\x09\x2e\x00\x70\x20\x61\x67\x61\x69\x6e\x2e";
+
+static unsigned char in[MAXN], out[LZ_BOUND(MAXN)], back[MAXN+GUARD];
+static unsigned long seed=1;
+
+static unsigned int rnd(void)
+{
+	seed=seed*1103515245UL+12345UL;
+	return (unsigned int)(seed>>16)&0x7fff;
+}
+
+/* kinds of data */
+static void fill(unsigned int n, int kind)
+{
+	unsigned int i;
+	for(i=0;i<n;i++)
+		switch(kind)
+		{
+			case 0:	in[i]=0; break;
+			case 1:	in[i]=(unsigned char)rnd(); break;
+			case 2:	in[i]=(unsigned char)"FAT12 BOOT SECTOR IO.SYS MSDOS.SYS "[i%35]; break;
+			case 3:	in[i]=(unsigned char)(i<n/2?rnd():i%7); break;
+			default: in[i]=(unsigned char)(rnd()%4); break;
+		}
+}
+
+static int round_trip(unsigned int n, int kind)
+{
+	unsigned int c, i;
+	long d;
+
+	fill(n,kind);
+	if((c=lz_pack(in,n,out,LZ_BOUND(n)))==0)
+	{
+		printf("lz_round: %u bytes of kind %d did not fit LZ_BOUND\n",n,kind);
+		return 1;
+	}
+	memset(back,0x5a,sizeof(back));
+	d=lz_unpack(out,c,back,n);
+	if(d!=(long)n || memcmp(back,in,n)!=0)
+	{
+		printf("lz_round: %u bytes of kind %d came back wrong\n",n,kind);
+		return 1;
+	}
+	for(i=n;i<n+GUARD;i++)
+		if(back[i]!=0x5a)
+		{
+			printf("lz_round: lz_unpack wrote past %u bytes\n",n);
+			return 1;
+		}
+	/* every shorter output must be refused, not overrun */
+	if(c>1 && lz_pack(in,n,out,c-1)!=0)
+	{
+		printf("lz_round: %u bytes of kind %d packed into less than %u\n",n,kind,c);
+		return 1;
+	}
+	if(n>0 && lz_unpack(out,c,back,n-1)>=0)
+	{
+		printf("lz_round: %u bytes of kind %d unpacked into %u\n",n,kind,n-1);
+		return 1;
+	}
+	return 0;
+}
+
+int main(void)
+{
+	static const unsigned int sizes[]={0,1,5,12,13,14,20,270,512,8704,32256,MAXN};
+	unsigned int i, c;
+	int k;
+	long d;
+
+	for(i=0;i<sizeof(sizes)/sizeof(sizes[0]);i++)
+		for(k=0;k<5;k++)
+			if(round_trip(sizes[i],k)!=0)
+				return 1;
+
+	/* other LZ4 writers */
+	d=lz_unpack(ref,sizeof(ref)-1,back,MAXN);
+	memset(in,'A',336);
+	memcpy(in+336,TEXT,sizeof(TEXT)-1);
+	if(d!=336+(long)sizeof(TEXT)-1 || memcmp(back,in,(unsigned int)d)!=0)
+	{
+		printf("lz_round: reference LZ4 block decoded wrong\n");
+		return 1;
+	}
+
+	/* damaged blocks: cut short, or with a byte changed */
+	fill(8704,2);
+	c=lz_pack(in,8704,out,LZ_BOUND(8704));
+	for(i=0;i<c;i++)
+	{
+		memset(back,0x5a,sizeof(back));
+		if(lz_unpack(out,i,back,8704)==8704)
+		{
+			printf("lz_round: block cut to %u bytes decoded in full\n",i);
+			return 1;
+		}
+		out[i]^=0xff;
+		lz_unpack(out,c,back,8704);
+		out[i]^=0xff;
+		for(k=0;k<GUARD;k++)
+			if(back[8704+k]!=0x5a)
+			{
+				printf("lz_round: damaged block written past the output\n");
+				return 1;
+			}
+	}
+	printf("lz_round: ok\n");
+	return 0;
+}
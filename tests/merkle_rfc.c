@@ -0,0 +1,105 @@
+/* merkle_rfc - the Merkle root of the first n inputs of the RFC 6962
+ * test vectors (as used by Certificate Transparency) must match the
+ * published roots, both through the .MKL file (mk_leaf, mk_root) and
+ * through mk_start/mk_add/mk_end. Also leaves a small image with its
+ * .MKL (mkl.img) for run.sh to check with rawmkl.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "merkle.h"
+
+#define FN	"rfc.MKL"
+#define TRACKS	8
+#define SPT	17
+
+static const char *inputs[8][2]=
+{
+	{"", ""},
+	{"\x00", "1"},
+	{"\x10", "1"},
+	{"\x20\x21", "2"},
+	{"\x30\x31", "2"},
+	{"\x40\x41\x42\x43", "4"},
+	{"\x50\x51\x52\x53\x54\x55\x56\x57", "8"},
+	{"\x60\x61\x62\x63\x64\x65\x66\x67\x68\x69\x6a\x6b\x6c\x6d\x6e\x6f", "16"}
+};
+
+static const char *roots[8]=
+{
+	"6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d",
+	"fac54203e7cc696cf0dfcb42c92a1d9dbaf70ad9e621f4bd8d98662f00e3c125",
+	"aeb6bcfe274b70a14fb067a5e5578264db0fa9b51af5e0ba159158f329e06e77",
+	"d37ee418976dd95753c1c73862b9398fa2a2cf9b4ff0fdfe8b30cd95209614b7",
+	"4e3bbb1f7b478dcfe71fb631631519a3bca12c9aefca1612bfce4c13a86264d4",
+	"76e67dadbcdf1e10e1b74ddc608abd2f98dfb16fbce75277b5232a127f2087ef",
+	"ddb89be403809e325750d3d263cd78929c2942b7942a34b77e122c9594a74c8c",
+	"5dc9da79a70659a9ad559cb701ded9a2ab9d823aad2f4960cfe370eff4604328"
+};
+
+static int same(const unsigned char *h, const char *hex)
+{
+	char s[2*MK_HASHLEN+1];
+	int i;
+	for(i=0;i<MK_HASHLEN;i++)
+		sprintf(s+2*i,"%02x",h[i]);
+	return strcmp(s,hex)==0;
+}
+
+int main(void)
+{
+	static char buf[SPT*512];
+	FILE *f, *img;
+	mk_ctx c;
+	unsigned char root[MK_HASHLEN], h[MK_HASHLEN];
+	unsigned long n, i;
+
+	for(n=1;n<=8;n++)
+	{
+		if((f=fopen(FN,"w+b"))==NULL)
+			return 1;
+		mk_start(&c);
+		/* leaves go to the file last first, as tracks of a resumed copy may */
+		for(i=n;i-->0;)
+			if(mk_leaf(f,i,inputs[i][0],atoi(inputs[i][1]))!=0)
+				return 1;
+		for(i=0;i<n;i++)
+		{
+			mk_hash(h,inputs[i][0],atoi(inputs[i][1]));
+			mk_add(&c,h);
+		}
+		if(mk_root(f,n,root)!=0 || !same(root,roots[n-1]))
+		{
+			printf("merkle_rfc: root of %lu leaves is wrong\n",n);
+			return 1;
+		}
+		mk_end(&c,h);
+		if(memcmp(h,root,MK_HASHLEN)!=0)
+		{
+			printf("merkle_rfc: mk_end differs from mk_root for %lu leaves\n",n);
+			return 1;
+		}
+		fclose(f);
+	}
+	remove(FN);
+
+	if((img=fopen("mkl.img","wb"))==NULL || (f=fopen("mkl.MKL","w+b"))==NULL)
+		return 1;
+	for(n=0;n<TRACKS;n++)
+	{
+		for(i=0;i<sizeof(buf);i++)
+			buf[i]=(char)(n*7+i%251);
+		if(fwrite(buf,sizeof(buf),1,img)!=1 || mk_leaf(f,n,buf,sizeof(buf))!=0)
+			return 1;
+	}
+	if(mk_root(f,TRACKS,root)!=0)
+		return 1;
+	fclose(f);
+	fclose(img);
+	printf("merkle_rfc: ok\n");
+	return 0;
+}
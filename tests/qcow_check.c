@@ -0,0 +1,210 @@
+/* qcow_check - qcow2 images from qcow.c must have consistent refcounts:
+ * every cluster in use (header, L1, L2 tables, data, refcount blocks and
+ * table) counted once, nothing else counted. Checked for a fresh image,
+ * one resumed after a crash, and one updated and then cut off while
+ * writing over the old refcounts, whose header must not point at data.
+ * Reads back every image through rhimg too.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "qcow.h"
+#include "rhimg.h"
+
+#define SPT		17
+#define TRACKS		600		/* 5 MB, 155 clusters of 32 KB */
+#define FN		"qcchk.qcow"
+#define ZFROM		400		/* all zero at first */
+#define ZTO		500
+
+static unsigned char *file;
+static long fsize;
+
+static unsigned long get32be(const unsigned char *p)
+{
+	return ((unsigned long)p[0]<<24)|((unsigned long)p[1]<<16)|((unsigned long)p[2]<<8)|p[3];
+}
+
+/* contents of track t as written by run gen; some tracks all zero, and
+ * at first a run of them that takes no clusters */
+static void fill(char *buf, unsigned long t, int gen)
+{
+	unsigned int i;
+	if(t%5==2 || (gen==0 && t>=ZFROM && t<ZTO))
+		memset(buf,0,SPT*512);
+	else
+		for(i=0;i<SPT*512;i++)
+			buf[i]=(char)(t*3+i%253+1+gen*80);
+}
+
+static int load_file(void)
+{
+	FILE *f=fopen(FN,"rb");
+	if(f==NULL)
+		return -1;
+	fseek(f,0L,SEEK_END);
+	fsize=ftell(f);
+	rewind(f);
+	free(file);
+	if((file=malloc(fsize))==NULL || fread(file,1,fsize,f)!=(size_t)fsize)
+		return -1;
+	fclose(f);
+	return 0;
+}
+
+/* mark cluster at off used; -1 if it is outside the file or used twice */
+static int use(unsigned char *used, unsigned long off)
+{
+	unsigned long c=off/QC_SIZE;
+	if(off%QC_SIZE!=0 || off+QC_SIZE>(unsigned long)fsize || used[c])
+		return -1;
+	used[c]=1;
+	return 0;
+}
+
+/* 0 if consistent, 1 if the header has no refcounts, -1 if broken */
+static int check(void)
+{
+	unsigned char *used;
+	unsigned long n, rt, rtn, l1, l1n, i, j, e, rb, k, rc;
+	int res=0;
+
+	if(load_file()!=0 || memcmp(file,"QFI\373",4)!=0)
+		return -1;
+	l1n=get32be(file+36);
+	l1=get32be(file+44);
+	rt=get32be(file+52);
+	rtn=get32be(file+56);
+	if(rt==0)
+		return 1;
+	n=(fsize+QC_SIZE-1)/QC_SIZE;
+	if((used=calloc(n,1))==NULL || use(used,0)!=0 || use(used,l1)!=0)
+		return -1;
+	for(i=0;i<l1n && res==0;i++)
+	{
+		if((e=get32be(file+l1+8*i+4))==0)
+			continue;
+		res|=use(used,e);
+		for(j=0;j<QC_L2 && res==0;j++)
+			if((k=get32be(file+e+8*j+4))!=0)
+				res|=use(used,k);
+	}
+	for(i=0;i<rtn && res==0;i++)
+		res|=use(used,rt+i*QC_SIZE);
+	for(i=0;i<rtn*QC_SIZE/8 && res==0;i++)
+	{
+		if((rb=get32be(file+rt+8*i+4))==0)
+			continue;
+		res|=use(used,rb);
+		for(j=0;j<QC_SIZE/2 && res==0;j++)
+		{
+			k=i*(QC_SIZE/2)+j;
+			rc=(file[rb+2*j]<<8)|file[rb+2*j+1];
+			if(rc!=(k<n?used[k]:0))
+			{
+				printf("cluster %lu: refcount %lu\n",k,rc);
+				res=-1;
+			}
+		}
+	}
+	free(used);
+	return res;
+}
+
+static int write_tracks(qcowout *q, unsigned long from, unsigned long to, int gen)
+{
+	char buf[SPT*512];
+	unsigned long t;
+	for(t=from;t<to;t++)
+	{
+		fill(buf,t,gen);
+		if(qcow_write(q,t*SPT,buf,SPT)!=0)
+			return -1;
+	}
+	return 0;
+}
+
+/* a crash: the file is left as it is, nothing more is written */
+static void crash(qcowout *q)
+{
+	close(q->fh);
+	free(q->l1);
+	free(q->l2);
+	free(q->cbuf);
+}
+
+static int readback(const int *gen)
+{
+	rhimg im;
+	char buf[SPT*512], got[SPT*512];
+	unsigned long t;
+	if(img_open(&im,FN)!=0)
+		return -1;
+	for(t=0;t<TRACKS;t++)
+	{
+		fill(buf,t,gen[t]);
+		if(img_read(&im,t*SPT,SPT,got)!=0 || memcmp(buf,got,sizeof(got))!=0)
+		{
+			printf("track %lu differs\n",t);
+			img_close(&im);
+			return -1;
+		}
+	}
+	img_close(&im);
+	return 0;
+}
+
+static int fail(const char *what)
+{
+	printf("FAIL: qcow_check: %s\n",what);
+	return 1;
+}
+
+int main(void)
+{
+	static int gen[TRACKS];
+	unsigned long sectors=(unsigned long)TRACKS*SPT, t;
+	qcowout q;
+
+	/* cut off half way, then resumed */
+	if(qcow_open(&q,FN,sectors,0)!=0 || write_tracks(&q,0,TRACKS/2,0)!=0)
+		return fail("writing");
+	crash(&q);
+	if(check()!=1)
+		return fail("header of a cut off image points at refcounts");
+	if(qcow_open(&q,FN,sectors,1)!=0 || write_tracks(&q,TRACKS/2,TRACKS,0)!=0 ||
+		qcow_close(&q)!=0)
+		return fail("resuming");
+	if(check()!=0)
+		return fail("refcounts after resume");
+	if(readback(gen)!=0)
+		return fail("reading back after resume");
+
+	/* updated: new clusters go over the old refcounts, then cut off */
+	if(qcow_open(&q,FN,sectors,1)!=0)
+		return fail("updating");
+	for(t=ZFROM-20;t<ZTO+20;t++)
+	{
+		gen[t]=1;
+		if(write_tracks(&q,t,t+1,1)!=0)
+			return fail("updating");
+	}
+	crash(&q);
+	if(check()!=1)
+		return fail("header of a cut off update points at refcounts");
+	if(qcow_open(&q,FN,sectors,1)!=0 || qcow_close(&q)!=0)
+		return fail("resuming the update");
+	if(check()!=0)
+		return fail("refcounts after the update");
+	if(readback(gen)!=0)
+		return fail("reading back the update");
+	free(file);
+	remove(FN);
+	printf("qcow_check: ok\n");
+	return 0;
+}
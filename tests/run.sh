@@ -0,0 +1,52 @@
+#!/bin/sh
+# Host tests of the parts that don't need a drive: sh tests/run.sh
+# Built with the system compiler in a scratch directory.
+set -e
+top=$(cd "$(dirname "$0")/.." && pwd)
+out=${TMPDIR:-/tmp}/rawhdd-tests.$$
+mkdir -p "$out"
+trap 'rm -rf "$out"' EXIT
+cd "$out"
+CC=${CC:-cc}
+
+$CC -O2 -I"$top" -o frame_resume "$top/tests/frame_resume.c" "$top/rhdest.c" "$top/rhimg.c" \
+	"$top/rhmap.c" "$top/frame.c" "$top/crc32c.c" "$top/lz.c" "$top/inflate.c" "$top/aes.c" \
+	"$top/sha256.c" "$top/md5.c" "$top/ewf.c" "$top/qcow.c" "$top/entropy.c"
+./frame_resume
+
+$CC -O2 -I"$top" -o grep_words "$top/tests/grep_words.c" "$top/trigram.c" "$top/crc32c.c"
+$CC -O2 -I"$top" -o rawgrep "$top/rawgrep.c" "$top/rhimg.c" "$top/rhmap.c" "$top/frame.c" \
+	"$top/crc32c.c" "$top/lz.c" "$top/inflate.c" "$top/aes.c" "$top/sha256.c" "$top/trigram.c"
+./grep_words
+./rawgrep grw.img cat "ab	cd" >grep.out
+grep -q "^LBA 1 offset 489: cat$" grep.out
+grep -q "offset 441: ab	cd$" grep.out
+echo "rawgrep unindexed words: ok"
+
+$CC -O2 -I"$top" -o qcow_check "$top/tests/qcow_check.c" "$top/qcow.c" "$top/rhimg.c" \
+	"$top/rhmap.c" "$top/frame.c" "$top/crc32c.c" "$top/lz.c" "$top/inflate.c" "$top/aes.c" \
+	"$top/sha256.c"
+./qcow_check
+
+$CC -O2 -I"$top" -o merkle_rfc "$top/tests/merkle_rfc.c" "$top/merkle.c" "$top/sha256.c"
+$CC -O2 -I"$top" -o rawmkl "$top/rawmkl.c" "$top/rhimg.c" "$top/rhmap.c" "$top/merkle.c" \
+	"$top/sha256.c" "$top/frame.c" "$top/crc32c.c" "$top/lz.c" "$top/inflate.c" "$top/aes.c"
+./merkle_rfc
+./rawmkl -s=17 -f=2 -n=3 mkl.img >mkl.out
+grep -q "^Root matches$" mkl.out
+printf X | dd of=mkl.img bs=1 seek=27000 conv=notrunc 2>/dev/null
+! ./rawmkl -s=17 -f=2 -n=3 mkl.img >mkl.out
+grep -q "^BAD: track 3$" mkl.out
+./rawmkl -s=17 -f=5 mkl.img >mkl.out
+echo "rawmkl ranges: ok"
+
+$CC -O2 -I"$top" -o aes_kat "$top/tests/aes_kat.c" "$top/aes.c" "$top/sha256.c"
+./aes_kat
+
+$CC -O2 -I"$top" -o lz_round "$top/tests/lz_round.c" "$top/lz.c"
+./lz_round
+
+$CC -O2 -I"$top" -o ewf_check "$top/tests/ewf_check.c" "$top/ewf.c" "$top/md5.c" "$top/rhimg.c" \
+	"$top/rhmap.c" "$top/frame.c" "$top/crc32c.c" "$top/lz.c" "$top/inflate.c" "$top/aes.c" \
+	"$top/sha256.c"
+./ewf_check
@@ -0,0 +1,94 @@
+/* trigram.c - per block bloom filter of the trigrams of its text.
+ * One bit per trigram keeps the filter at a sixteenth of the block;
+ * blocks without text leave it nearly empty, so most of a drive is
+ * ruled out for any word of four or more printable characters.
+ *
+ * Copyright 2019 Mihai Gaitos, mihaig@hawk.ro
+ * See rawhdd.c for license terms.
+ */
+
+#include <string.h>
+#include "trigram.h"
+
+int tri_fold(int c)
+{
+	return c>='A' && c<='Z'?c+'a'-'A':c;
+}
+
+static unsigned int bit(int a, int b, int c, unsigned int nbits)
+{
+	unsigned long h=((unsigned long)a<<16|(unsigned long)b<<8|c)*2654435761UL;
+	return (unsigned int)((h>>16)%nbits);
+}
+
+/* a run of n characters, step bytes apart */
+static void run(const unsigned char *p, unsigned int n, unsigned int step,
+	unsigned char *bloom, unsigned int nbits)
+{
+	unsigned int i, k;
+	for(i=0;i+2<n;i++,p+=step)
+	{
+		k=bit(tri_fold(p[0]),tri_fold(p[step]),tri_fold(p[2*step]),nbits);
+		bloom[k>>3]|=1<<(k&7);
+	}
+}
+
+/* step 1: bytes; step 2: UTF-16LE starting at byte from */
+static void scan(const unsigned char *buf, unsigned int len, unsigned int step,
+	unsigned int from, unsigned char *bloom, unsigned int nbits)
+{
+	unsigned int i, start=from, n=0;
+	for(i=from;i+step<=len;i+=step)
+	{
+		if(buf[i]>=0x20 && buf[i]<0x7f && (step==1 || buf[i+1]==0))
+		{
+			if(n++==0)
+				start=i;
+			continue;
+		}
+		if(n>=TRI_MINRUN)
+			run(buf+start,n,step,bloom,nbits);
+		n=0;
+	}
+	if(n>=TRI_MINRUN)
+		run(buf+start,n,step,bloom,nbits);
+}
+
+/* filter of one block; bloom has TRI_BYTES(len) bytes */
+void tri_block(const unsigned char *buf, unsigned int len, unsigned char *bloom)
+{
+	unsigned int nbits=TRI_BYTES(len)*8;
+	memset(bloom,0,TRI_BYTES(len));
+	scan(buf,len,1,0,bloom,nbits);
+	scan(buf,len,2,0,bloom,nbits);
+	scan(buf,len,2,1,bloom,nbits);
+}
+
+/* 1 if the filters can rule word out: it is text as tri_block sees it.
+ * A shorter word may sit in a run too short to be indexed, and a trigram
+ * with a tab or a byte past 0x7e is never in the filter */
+int tri_indexed(const char *word)
+{
+	unsigned int n;
+	for(n=0;word[n];n++)
+		if((unsigned char)word[n]<0x20 || (unsigned char)word[n]>=0x7f)
+			return 0;
+	return n>=TRI_MINRUN;
+}
+
+/* 0 if word is surely not in the block; words the filters can't rule
+ * out always may be */
+int tri_maybe(const unsigned char *bloom, unsigned int nbytes, const char *word)
+{
+	unsigned int n=strlen(word), i, k;
+	if(!tri_indexed(word))
+		return 1;
+	for(i=0;i+2<n;i++)
+	{
+		k=bit(tri_fold((unsigned char)word[i]),tri_fold((unsigned char)word[i+1]),
+			tri_fold((unsigned char)word[i+2]),nbytes*8);
+		if(!(bloom[k>>3]&1<<(k&7)))
+			return 0;
+	}
+	return 1;
+}
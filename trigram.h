@@ -0,0 +1,23 @@
+/* trigram.h - per block bloom filter of the trigrams of its text, so a
+ * keyword search only reads the blocks that may hold the keyword.
+ * Text is any run of 4 or more printable ASCII characters, in bytes or
+ * as UTF-16LE; letters are folded to lower case.
+ */
+
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+/* .TRI file: "RHT1", block size (32 bit LE), then a filter of
+ * TRI_BYTES(block size) bytes per block, all zero if not copied. One bit
+ * (a hash) per trigram; a word matches if the bits of all its trigrams
+ * are set. Words split between two blocks are not found. */
+#define TRI_HDRLEN	8
+#define TRI_MINRUN	4	/* shorter runs are mostly noise in binary data */
+#define TRI_BYTES(n)	((n)/16)
+
+void tri_block(const unsigned char *buf, unsigned int len, unsigned char *bloom);
+int tri_indexed(const char *word);
+int tri_maybe(const unsigned char *bloom, unsigned int nbytes, const char *word);
+int tri_fold(int c);
+
+#endif